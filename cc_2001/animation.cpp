@@ -0,0 +1,250 @@
+#include "animation.h"
+#include "contact.h"
+#include <math.h>
+#include <chrono>
+
+
+// ***********************************************************
+//							Animation
+// ***********************************************************
+Animation::Animation()
+{
+	scene = 0;
+	step = 0;
+	everything = false;
+	length = 0;
+	computed = 0;
+	shown = ready = -1;
+	quit = false;
+
+	for (int b = 0; b < 2; b++)
+	{
+		frames[b].balloons = 0;
+		frames[b].count = 0;
+		frames[b].time = 0;
+		frames[b].number = -1;
+		frames[b].rebuilt = 0;
+		frames[b].milliseconds = 0;
+		frames[b].deformation = 0;
+	}
+}
+
+Animation::~Animation()
+{
+	stop();
+}
+
+void Animation::start(const Scene& scene, double step, bool everything)
+{
+	stop();
+
+	this->scene = &scene;
+	this->step = step;
+	this->everything = everything;
+
+	// the keys are sorted by balloon
+	int n = scene.count;
+	first_key.assign(n + 1, 0);
+	length = 0;
+	int k;
+
+	for (k = 0; k < scene.count_keys; k++)
+	{
+		first_key[scene.keys[k].balloon + 1]++;
+		if (scene.keys[k].time > length) length = scene.keys[k].time;
+	}
+	for (k = 0; k < n; k++)
+		first_key[k + 1] += first_key[k];
+
+	// the balloons of both buffers - not set up, the first frame of each
+	// sets up all of them
+	for (int b = 0; b < 2; b++)
+	{
+		Frame& f = frames[b];
+		f.balloons = new Balloon[n];
+		f.count = n;
+		f.number = -1;
+		f.arena.reserve(n*Balloon::storage_size(scene.segments, scene.pies));
+	}
+
+	computed = 0;
+	shown = ready = -1;
+	quit = false;
+	thread = std::thread(&Animation::run, this);
+}
+
+void Animation::stop()
+{
+	if (thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			quit = true;
+		}
+		changed.notify_all();
+		thread.join();
+	}
+
+	// the balloons first, their meshes live in the arenas
+	for (int b = 0; b < 2; b++)
+	{
+		delete frames[b].deformation;
+		frames[b].deformation = 0;
+		delete[] frames[b].balloons;
+		frames[b].balloons = 0;
+		frames[b].count = 0;
+		frames[b].number = -1;
+		frames[b].arena.release();
+	}
+	shown = ready = -1;
+	scene = 0;
+}
+
+const Frame *Animation::latest()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	// take the finished one, its buffer is free again for the thread
+	if (ready >= 0)
+	{
+		shown = ready;
+		ready = -1;
+		changed.notify_all();
+	}
+	return shown >= 0 ? frames + shown : 0;
+}
+
+const Frame *Animation::next()
+{
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		changed.wait(guard, [this] { return ready >= 0 || quit || !thread.joinable(); });
+	}
+	return latest();
+}
+
+void Animation::run()
+{
+	for (int number = 0; ; number++)
+	{
+		int target;
+		{
+			// the buffer which is not drawn - once the last frame is taken
+			std::unique_lock<std::mutex> guard(lock);
+			changed.wait(guard, [this] { return ready < 0 || quit; });
+			if (quit) return;
+			target = shown == 0 ? 1 : 0;
+		}
+
+		Frame& f = frames[target];
+		f.number = number;
+		f.time = length > 0 ? fmod(number*step, length) : 0;
+		compute(f);
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			ready = target;
+			computed++;
+		}
+		changed.notify_all();
+	}
+}
+
+void Animation::pose(int k, double t, double& x, double& y, double& z, double& radius, double& pressure) const
+{
+	const Balloon& line = scene->balloons[k];
+	x = line.x; y = line.y; z = line.z;
+	radius = line.radius; pressure = line.pressure;
+
+	// from the line (or the key before) to the next key
+	double from = 0;
+	for (int i = first_key[k]; i < first_key[k + 1]; i++)
+	{
+		const Keyframe& key = scene->keys[i];
+		if (key.time <= t)
+		{
+			x = key.x; y = key.y; z = key.z;
+			radius = key.radius; pressure = key.pressure;
+			from = key.time;
+			continue;
+		}
+
+		double s = (t - from)/(key.time - from);
+		x += s*(key.x - x); y += s*(key.y - y); z += s*(key.z - z);
+		radius += s*(key.radius - radius);
+		pressure += s*(key.pressure - pressure);
+		break;
+	}
+}
+
+void Animation::compute(Frame& frame)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	Balloon *b = frame.balloons;
+	int n = frame.count;
+	int k;
+	size_t c;
+
+	// the object alone - through its Deformation
+	if (!everything)
+	{
+		std::vector<Pose> poses(n);
+		for (k = 0; k < n; k++)
+			pose(k, frame.time, poses[k].x, poses[k].y, poses[k].z, poses[k].radius, poses[k].pressure);
+
+		frame.rebuilt = press_object(b, &poses[0], n, frame.deformation, scene->segments, scene->pies,
+									 scene->object_color, scene->around_color, &frame.arena);
+
+		frame.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return;
+	}
+
+	// what touched what in the frame the buffer holds - the deformed
+	// balloons reach further than their spheres, so does the search
+	std::vector<unsigned char> dirty(n, 0), moved(n, 0);
+	std::vector<Contact> before, after;
+	bool fresh = !b[0].setup_complete;
+	if (!fresh) find_contacts(b, n, before);
+
+	for (k = 0; k < n; k++)
+	{
+		double x, y, z, radius, pressure;
+		pose(k, frame.time, x, y, z, radius, pressure);
+
+		Balloon& B = b[k];
+		if (fresh || B.x != x || B.y != y || B.z != z || B.radius != radius || B.pressure != pressure)
+		{
+			B.x = x; B.y = y; B.z = z;
+			B.radius = radius; B.pressure = pressure;
+			moved[k] = dirty[k] = 1;
+		}
+	}
+
+	// and what touches what now (with the old meshes of the ones which
+	// stay) - a balloon next to one that moved is deformed again
+	if (!fresh)
+	{
+		find_contacts(b, n, after);
+		before.insert(before.end(), after.begin(), after.end());
+
+		for (c = 0; c < before.size(); c++)
+		{
+			int p = before[c].a, q = before[c].b;
+			if (moved[q]) dirty[p] = 1;
+			if (moved[p]) dirty[q] = 1;
+		}
+	}
+
+	frame.rebuilt = 0;
+	for (k = 0; k < n; k++)
+	{
+		if (!dirty[k]) continue;
+		b[k].setup(scene->segments, scene->pies, k == 0 ? scene->object_color : scene->around_color, &frame.arena);
+		frame.rebuilt++;
+	}
+
+	deform_all(b, n, &dirty[0]);
+
+	frame.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,104 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "scene.h"
+#include "deformation.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// one step of an animation: the balloons where the keys put them at one
+// time, set up and deformed
+struct Frame
+{
+	Balloon *balloons;
+	int count;
+
+	// time in the animation and the number of the frame since start
+	double time;
+	int number;
+
+	// balloons set up again for this frame - the others were still right
+	// from the frame before in the same buffer
+	int rebuilt;
+
+	// how long posing, setup and deformation took
+	double milliseconds;
+
+	// the meshes
+	Arena arena;
+
+	// of balloons[0] when the object alone is deformed
+	Deformation *deformation;
+};
+
+// the balloons of a scene moving through its keys. a balloon starts where
+// its line in the file puts it (time 0) and goes straight from key to key,
+// radius and pressure included, and stays at its last key. the whole
+// thing starts over after the last key of all.
+//
+// the frames are computed on a thread of their own into two buffers: the
+// next frame is set up and deformed in one while the other is drawn. a
+// buffer only sets up the balloons which moved since it was used last,
+// or which are deformed and touch (or touched) one that moved - the rest
+// of its meshes are still right. an object deformed alone keeps its
+// Deformation in the buffer: a moved balloon only re-presses the vertices
+// it can reach, the object is set up again only when it moves itself.
+class Animation
+{
+public:
+	Animation();
+	~Animation();
+
+	// start computing the frames of scene (read, set up or not), step
+	// apart in time, deformed like scene.deform(everything) would. the
+	// scene must stay until stop.
+	void start(const Scene& scene, double step, bool everything);
+
+	// wait for the thread, free the frames
+	void stop();
+
+	// the newest finished frame, 0 before the first one. does not wait -
+	// without a new one it is the frame of the last call. it stays as it
+	// is until the next call, the thread only writes into the other buffer.
+	const Frame *latest();
+
+	// the same, but waits for a frame newer than the last one
+	const Frame *next();
+
+	// time of the last key of all, 0 if nothing moves
+	double length;
+
+	// frames computed so far
+	int computed;
+
+private:
+	// the thread: frame after frame until stop
+	void run();
+
+	// balloons of the frame posed at its time, then set up and deformed
+	void compute(Frame& frame);
+
+	// where the keys put balloon k at time t
+	void pose(int k, double t, double& x, double& y, double& z, double& radius, double& pressure) const;
+
+	const Scene *scene;
+	double step;
+	bool everything;
+
+	// the keys of balloon k are first_key[k] .. first_key[k + 1] - 1
+	std::vector<int> first_key;
+
+	Frame frames[2];
+
+	// the buffer being drawn, the one finished and not taken yet (-1 none)
+	int shown, ready;
+	bool quit;
+
+	std::mutex lock;
+	std::condition_variable changed;
+	std::thread thread;
+};
+
+#endif
@@ -6,7 +6,10 @@
 #include <gl\glu.h>			// Header File For The GLu32 Library
 #include <gl\glaux.h>		// Header File For The Glaux Library
 
-#include "balloon.h"
+#include "scene.h"
+#include "animation.h"
+#include "loader.h"
+#include "renderer.h"
 
 #define PI 3.1415
 
@@ -17,10 +20,21 @@ HWND		hWnd=NULL;		// Holds Our Window Handle
 HINSTANCE	hInstance;		// Holds The Instance Of The Application
 
 char		filename[255];
+char		title[300];			// of the window, without the progress
+Scene		scene;				// the balloons of the file
+Loader		loading;			// reads and deforms it while the window runs
+bool		loaded;				// the scene (or the default balloon) is in the buffers
+const Balloon *previewed;		// the undeformed balloons shown meanwhile
+int			shown_percent;		// the progress in the title
+Renderer	renderer;			// draws them from vertex buffers
+Animation	animation;			// the frames of a file with keys
+const Frame	*shown_frame;		// the one in the buffers
+double		animation_step = 1.0/30;	// seconds of the keys per frame
 Balloon		*balony;
 int			count;
 int			around_style;
 int			object_style;
+bool		deform_everything;	// -all: every balloon, not only the object
 
 GLuint	base;				// Base Display List For The Font Set
 GLfloat	rot;				// Used To Rotate The Text
@@ -43,66 +57,97 @@ struct point
 
 LRESULT	CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);	// Declaration For WndProc
 
-void read_data(const char *filename, Balloon *data)
+// OpenGL functions newer than 1.1 for the renderer
+void *load_gl(const char *name)
+{
+	void *f = (void *)wglGetProcAddress(name);
+
+	// some drivers return small numbers instead of 0
+	if (f == (void *)1 || f == (void *)2 || f == (void *)3 || f == (void *)-1) return 0;
+	return f;
+}
+
+// the balloon shown without a file (or when it cannot be read)
+void default_balloon()
 {
-	FILE *stream;
+	object_style = 3; around_style = 0;
+	
+	balony = new Balloon[1];
+	count = 1;
 	
-	if ( ( strcmp(filename, "") == 0) || ((stream = fopen(filename, "rt")) == NULL) )
+	balony[0].x = 1;
+	balony[0].setup(16, 16, 1);
+//	balony[1].setup(16, 16, 0);
+//	balony[0].deform(balony[1]);
+}
+
+void read_data(const char *filename, Balloon *data)
+{
+	previewed = 0;
+	shown_percent = -1;
+
+	if (strcmp(filename, "") == 0)
 	{
-		
-		object_style = 3; around_style = 0;
-		
-		balony = new Balloon[1];
-		count = 1;
-		
-		balony[0].x = 1;
-		balony[0].setup(16, 16, 1);
-//		balony[1].setup(16, 16, 0);
-//		balony[0].deform(balony[1]);
-		
+		default_balloon();
+		loaded = true;
 		return;
 	}
-	else
+
+	// read, setup and deform on another thread - DrawGLScene shows the
+	// balloons undeformed as soon as they are read and the scene once it
+	// is ready (see check_loading)
+	loaded = false;
+	loading.start(scene, filename, deform_everything, SCENE_LEVELS);
+}
+
+// the state of the loading thread into the window
+void check_loading()
+{
+	// the undeformed balloons, once
+	const Balloon *preview = loading.preview();
+	if (preview && preview != previewed)
+	{
+		previewed = preview;
+		object_style = scene.object_style;
+		around_style = scene.around_style;
+		renderer.upload(preview, loading.count_preview);
+	}
+
+	if (!loading.finished())
 	{
-		// read file
-		int i, seg, pie, obj_usecolor, around_usecolor;
-		
-		fscanf(stream, "%i %i %i %i %i", &i, &seg, &pie, &obj_usecolor, &around_usecolor);
-		fscanf(stream, "%i %i", &object_style, &around_style);
-		
-		balony = new Balloon[i];
-		count = i;
-		
-		
-		float x, y, z, rad, pre;
-		
-		for (i = 0; i < count; i++)
+		int percent = (int)(100*loading.fraction());
+		if (percent != shown_percent)
 		{
-			fscanf(stream,"%f %f %f %f %f", &x, &y, &z, &rad, &pre);
-			
-			balony[i].x = x; balony[i].y = y; balony[i].z = z;
-			balony[i].radius = rad; balony[i].pressure = pre;
-			if (i == 0)
-			{
-				if (obj_usecolor)
-					balony[i].setup(seg, pie, true);
-				else
-					balony[i].setup(seg, pie, false);
-			}
-			else
-			{
-				if (around_usecolor != 0)
-					balony[i].setup(seg, pie, true);
-				else
-					balony[i].setup(seg, pie, false);
-			}
-			if (i > 0) 
-				balony[0].deform(balony[i]);
+			char text[400];
+			sprintf(text, "%s - %s %d%%", title, loading.stage(), percent);
+			SetWindowText(hWnd, text);
+			shown_percent = percent;
 		}
-		
-		fclose(stream);
-		
+		return;
 	}
+
+	// the preview goes, the buffers have their own copy
+	loading.stop();
+	loaded = true;
+	SetWindowText(hWnd, title);
+
+	if (!loading.ok)
+	{
+		// say what is wrong with the file, then show the default balloon
+		MessageBox(NULL, scene.error(), "Balloon modeling", MB_OK | MB_ICONEXCLAMATION);
+		default_balloon();
+		renderer.upload(balony, count);
+		return;
+	}
+
+	// the balloons belong to the scene, all of them at once into the buffers
+	balony = scene.balloons;
+	count = scene.count;
+
+	// the frames are computed while the window is open, the preview stays
+	// until the first one is there
+	if (scene.count_keys > 0) animation.start(scene, animation_step, deform_everything);
+	else renderer.upload(scene.level, scene.count_levels, count);
 }
 
 
@@ -131,6 +176,11 @@ int InitGL(GLvoid)										// All Setup For OpenGL Goes Here
 	// buildspheres
 	read_data(filename, balony);
 
+	// and into the graphics card with them - a file comes later
+	renderer.init(load_gl);
+	if (loaded) renderer.upload(balony, count);
+	shown_frame = 0;
+
 
 	glShadeModel(GL_SMOOTH);							// Enable Smooth Shading
 	glClearColor(0.0f, 0.0f, 0.0f, 0.5f);				// Black Background
@@ -145,30 +195,6 @@ int InitGL(GLvoid)										// All Setup For OpenGL Goes Here
 	return TRUE;										// Initialization Went OK
 }
 
-void DrawA(int k, int i)
-{
-	glColor4d( balony[k].mesh[i].A.R, balony[k].mesh[i].A.G, 
-		balony[k].mesh[i].A.B, balony[k].mesh[i].A.A);
-	glNormal3d( balony[k].mesh[i].A.nx, balony[k].mesh[i].A.ny, balony[k].mesh[i].A.nz);
-	glVertex3d( balony[k].mesh[i].A.x, balony[k].mesh[i].A.y, balony[k].mesh[i].A.z);
-}
-
-void DrawB(int k, int i)
-{
-	glColor4d( balony[k].mesh[i].B.R, balony[k].mesh[i].B.G, 
-		balony[k].mesh[i].B.B, balony[k].mesh[i].B.A);
-	glNormal3d( balony[k].mesh[i].B.nx, balony[k].mesh[i].B.ny, balony[k].mesh[i].B.nz);
-	glVertex3d( balony[k].mesh[i].B.x, balony[k].mesh[i].B.y, balony[k].mesh[i].B.z);
-}
-
-void DrawC(int k, int i)
-{
-	glColor4d( balony[k].mesh[i].C.R, balony[k].mesh[i].C.G, 
-		balony[k].mesh[i].C.B, balony[k].mesh[i].C.A);
-	glNormal3d( balony[k].mesh[i].C.nx, balony[k].mesh[i].C.ny, balony[k].mesh[i].C.nz);
-	glVertex3d( balony[k].mesh[i].C.x, balony[k].mesh[i].C.y, balony[k].mesh[i].C.z);
-}
-
 int DrawGLScene(GLvoid)									// Here's Where We Do All The Drawing
 {
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);	// Clear Screen And Depth Buffer
@@ -177,108 +203,24 @@ int DrawGLScene(GLvoid)									// Here's Where We Do All The Drawing
 	glRotatef(rot,1.0f,0.0f,0.0f);						// Rotate On The X Axis
 	glRotatef(rot*1.5f,0.0f,1.0f,0.0f);					// Rotate On The Y Axis
 
-	int i;
-
-	// draw the object
-	switch (object_style)
-	{
-	case 0:
-		// do not draw
-		break;
-	case 1:
-		// draw as points
-		glBegin(GL_POINTS);
-			for(i = 0; i < balony[0].count_point_list; i++)
-			{
-				glColor4d( balony[0].point_list[i].R, balony[0].point_list[i].G, 
-					balony[0].point_list[i].B, balony[0].point_list[i].A);
-				glNormal3d( balony[0].point_list[i].nx, balony[0].point_list[i].ny, balony[0].point_list[i].nz);
-				glVertex3d( balony[0].point_list[i].x, balony[0].point_list[i].y, balony[0].point_list[i].z);
-			}
-		glEnd();
-		break;
-	case 2:
-		// draw as lines
-		glBegin(GL_LINES);
-			for (i = 0; i < balony[0].count; i++)
-			{
-				DrawA(0, i);
-				DrawB(0, i);
-				DrawA(0, i);
-				DrawC(0, i);
-				DrawB(0, i);
-				DrawC(0, i);
-			}
-		glEnd();
-		break;
-	case 3:
-		// draw as polygons
-		glBegin(GL_TRIANGLES);
-			for(i = 0; i < balony[0].count_point_list; i++)
-			{
-				glColor4d( balony[0].point_list[i].R, balony[0].point_list[i].G, 
-					balony[0].point_list[i].B, balony[0].point_list[i].A);
-				glNormal3d( balony[0].point_list[i].nx, balony[0].point_list[i].ny, balony[0].point_list[i].nz);
-				glVertex3d( balony[0].point_list[i].x, balony[0].point_list[i].y, balony[0].point_list[i].z);
-			}
-		glEnd();
-		break;
-	default:
-		break;
-	}
-	// object drawn
+	// the preview or the scene, when the loading thread has them
+	if (!loaded) check_loading();
 
-	for (int j = 1; j < count; j++)
+	// a new frame of the animation replaces the meshes
+	if (loaded && scene.count_keys > 0)
 	{
-		if (balony[j].setup_complete)
+		const Frame *latest = animation.latest();
+		if (latest != shown_frame)
 		{
-			switch(around_style)
-			{
-			case 0:
-				// do nothing
-				break;
-			case 1:
-				// points
-				glBegin(GL_POINTS);
-				for(i = 0; i < balony[j].count; i++)
-				{
-					DrawA(j, i);
-					DrawB(j, i);
-					DrawC(j, i);
-				}
-				glEnd();
-				break;
-			case 2:
-				// lines
-				glBegin(GL_LINES);
-					for (i = 0; i < balony[j].count; i++)
-					{
-						DrawA(j, i);
-						DrawB(j, i);
-						DrawA(j, i);
-						DrawC(j, i);
-						DrawB(j, i);
-						DrawC(j, i);
-					}
-				glEnd();
-				break;
-			case 3:
-				glBegin(GL_TRIANGLES);
-					for(i = 0; i < balony[j].count; i++)
-					{
-						DrawA(j, i);
-						DrawB(j, i);
-						DrawC(j, i);
-					}
-				glEnd();
-				break;
-			default:
-				// do nothing
-				break;
-			}
+			shown_frame = latest;
+			renderer.upload(latest->balloons, latest->count);
 		}
 	}
 
+	// everything is in the buffers
+	renderer.draw(object_style, around_style);
+	if (!loaded) renderer.draw_progress(loading.fraction());
+
 	glFlush();
 
 	rot+=1.0f;											// Increase The Rotation Variable
@@ -288,7 +230,11 @@ int DrawGLScene(GLvoid)									// Here's Where We Do All The Drawing
 
 GLvoid KillGLWindow(GLvoid)								// Properly Kill The Window
 {
-	delete[] balony;
+	loading.stop();										// The Scene Is Its Until Then
+	animation.stop();									// Before The Scene It Reads
+	if (hRC) renderer.release();						// Buffers Go With The Context
+	if (balony != scene.balloons) delete[] balony;
+	scene.clear();
 
 	if (fullscreen)										// Are We In Fullscreen Mode?
 	{
@@ -577,12 +523,20 @@ int WINAPI WinMain(	HINSTANCE	hInstance,			// Instance
 		fullscreen=FALSE;							// Windowed Mode
 //	}
 
+	// "-all filename.bal" deforms the surrounding balloons too
+	if (strncmp(lpCmdLine, "-all ", 5) == 0)
+	{
+		deform_everything = true;
+		lpCmdLine += 5;
+	}
+
 	strcpy(filename, lpCmdLine);
 
 	char name[255];
 
 	strcpy(name, "Balloon modeling: ");
 	strcat(name, filename);
+	strcpy(title, name);
 
 	// Create Our OpenGL Window
 	if (!CreateGLWindow(name,640,480,16,fullscreen))
@@ -0,0 +1,50 @@
+#include "arena.h"
+
+
+// ***********************************************************
+//							Arena
+// ***********************************************************
+Arena::Arena()
+{
+	raw = 0;
+	block = 0;
+	capacity = 0;
+	offset = 0;
+}
+
+Arena::~Arena()
+{
+	release();
+}
+
+void Arena::reserve(size_t bytes)
+{
+	offset = 0;
+	if (bytes <= capacity) return;
+
+	delete[] raw;
+
+	bytes = rounded(bytes);
+	raw = new char[bytes + ARENA_ALIGN];
+	block = raw + (ARENA_ALIGN - (size_t)raw % ARENA_ALIGN) % ARENA_ALIGN;
+	capacity = bytes;
+}
+
+void *Arena::alloc(size_t bytes)
+{
+	bytes = rounded(bytes);
+	if (bytes > capacity - offset) return 0;
+
+	void *p = block + offset;
+	offset += bytes;
+	return p;
+}
+
+void Arena::release()
+{
+	delete[] raw;
+	raw = 0;
+	block = 0;
+	capacity = 0;
+	offset = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// every piece handed out starts on a cache line
+#define ARENA_ALIGN 64
+
+// one big block cut into pieces from the front. nothing is freed on its
+// own, the whole block goes at once - for the geometry of a scene whose
+// size is known from the header before the balloons are set up.
+class Arena
+{
+public:
+	Arena();
+	~Arena();
+
+	// a block of at least bytes, everything handed out before is gone
+	void reserve(size_t bytes);
+
+	// aligned piece of the block, 0 if it does not fit any more
+	void *alloc(size_t bytes);
+
+	// free the whole block
+	void release();
+
+	size_t size() const { return capacity; }
+	size_t used() const { return offset; }
+
+	// bytes taken by a piece of this size, with the alignment
+	static size_t rounded(size_t bytes)
+	{
+		return (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	}
+
+private:
+	char *raw;		// as returned by new
+	char *block;	// raw aligned up
+	size_t capacity;
+	size_t offset;
+};
+
+#endif
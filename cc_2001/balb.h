@@ -0,0 +1,63 @@
+#ifndef BALB_H
+#define BALB_H
+
+// .balb - binary scene, read by mapping it into memory.
+//
+//   BalbHeader (64 bytes)
+//   BalbBalloon per balloon (64 bytes each)
+//   if BALB_GEOMETRY: per balloon, on a 64 byte boundary, the storage of
+//       the set up (and deformed) balloon exactly as Balloon keeps it in
+//       memory - Balloon::storage_size(segments, pies) bytes, the gaps
+//       between the arrays and the padding of the triangles zero
+//
+// the geometry is only usable on machines with the same byte order and
+// struct layout as the writer; the header records both and readers fall
+// back to the balloon table (and a new setup) when they differ.
+
+#define BALB_MAGIC "BALB"
+#define BALB_VERSION 1
+
+// flags
+#define BALB_GEOMETRY	1		// meshes are in the file
+#define BALB_EVERYTHING	2		// all balloons deformed, not only the object
+
+// written as 0x01020304 - tells the byte order
+#define BALB_BYTE_ORDER 0x01020304u
+
+struct BalbHeader
+{
+	char magic[4];
+	unsigned int version;
+	unsigned int byte_order;
+	unsigned int flags;
+
+	// sizeof(Bounds), sizeof(Triangle) of the writer
+	unsigned int bounds_size;
+	unsigned int triangle_size;
+
+	// the .bal header
+	int count;
+	int segments, pies;
+	int object_color, around_color;
+	int object_style, around_style;
+
+	unsigned int reserved[3];
+};
+
+struct BalbBalloon
+{
+	double x, y, z;
+	double radius;
+	double pressure;
+
+	// of the stored mesh
+	double bound;
+
+	// from the start of the file, 0 without geometry
+	unsigned long long geometry;
+
+	int color;
+	int reserved;
+};
+
+#endif
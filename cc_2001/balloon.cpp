@@ -1,9 +1,57 @@
 
 #include "balloon.h"
+#include "deform_kernel.h"
+#include "stats.h"
+#include "grid.h"
+#include "tessellation.h"
+#include "threadpool.h"
+#include <limits.h>
 #include <math.h>
 #include <memory.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
 
-#define PI 3.1415
+
+// ***********************************************************
+//							Bounds
+// ***********************************************************
+void bounds_empty(Bounds& b)
+{
+	b.min_x = b.min_y = b.min_z = (real)1e300;
+	b.max_x = b.max_y = b.max_z = (real)-1e300;
+}
+
+void bounds_extend(Bounds& b, double x, double y, double z)
+{
+	if (x < b.min_x) b.min_x = x;
+	if (y < b.min_y) b.min_y = y;
+	if (z < b.min_z) b.min_z = z;
+	if (x > b.max_x) b.max_x = x;
+	if (y > b.max_y) b.max_y = y;
+	if (z > b.max_z) b.max_z = z;
+}
+
+bool bounds_touch(const Bounds& b, double x, double y, double z, double radius)
+{
+	double dx = 0, dy = 0, dz = 0;
+
+	if (x < b.min_x) dx = b.min_x - x; else if (x > b.max_x) dx = x - b.max_x;
+	if (y < b.min_y) dy = b.min_y - y; else if (y > b.max_y) dy = y - b.max_y;
+	if (z < b.min_z) dz = b.min_z - z; else if (z > b.max_z) dz = z - b.max_z;
+
+	// a little slack - the kernel compares sqrt(d2) < radius
+	return dx*dx + dy*dy + dz*dz <= radius*radius*(1 + REAL_SLACK);
+}
+
+
+// largest of the partial results of a parallel loop - the order in
+// which the chunks finish does not matter
+static void reduce_max(double& result, double value, std::mutex& lock)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	if (value > result) result = value;
+}
 
 
 // ***********************************************************
@@ -23,150 +71,246 @@ Balloon::Balloon()
 	radius = 1.0;
 	pressure = 1.0;
 	
+	storage = 0;
+	angles = 0;
+	ring = col_sin = col_cos = 0;
+	adaptive = false;
 	setup_complete = false;
 }
 
 
 Balloon::~Balloon()
 {
-	// delete triangles
-	if (setup_complete)
+	release();
+	delete[] angles;
+}
+
+void Balloon::release()
+{
+	// the arena frees its pieces itself, only the own block goes
+	own.release();
+	storage = 0;
+	setup_complete = false;
+}
+
+size_t Balloon::storage_size(int segments, int pies)
+{
+	size_t n = (size_t)(segments+1)*(pies+1);
+	size_t triangles = (size_t)2*segments*pies;
+
+	return Arena::rounded(6*n*sizeof(real))
+		+ Arena::rounded((segments+1)*sizeof(Bounds))
+		+ Arena::rounded((pies+1)*sizeof(Bounds))
+		+ Arena::rounded(n)
+		+ Arena::rounded(triangles*sizeof(Triangle));
+}
+
+bool Balloon::lattice_fits(int segments, int pies)
+{
+	if (segments < 1 || pies < 1) return false;
+
+	// carve indexes the block of all six arrays, deform the triangles
+	long long n = ((long long)segments+1)*((long long)pies+1);
+	if (n > INT_MAX/6) return false;
+
+	// below 2^31 vertices this is far from overflowing a long long
+	unsigned long long bytes = 6*n*sizeof(real) + (segments+pies+2)*sizeof(Bounds) + n
+		+ 2*n*sizeof(Triangle) + 5*ARENA_ALIGN;
+	return bytes <= SIZE_MAX;
+}
+
+void Balloon::carve()
+{
+	// every lattice vertex is stored once, the triangles only index them
+	count_vertices = (segments+1)*(pies+1);
+	rows = segments+1;
+	cols = pies+1;
+	count = 2*segments*pies;
+
+	// cut the storage - the same order and sizes as storage_size
+	char *p = storage;
+
+	// one block for all six arrays
+	real *block = (real *)p;
+	p += Arena::rounded(6*count_vertices*sizeof(real));
+	vertices.x = block;
+	vertices.y = block + count_vertices;
+	vertices.z = block + 2*count_vertices;
+	vertices.nx = block + 3*count_vertices;
+	vertices.ny = block + 4*count_vertices;
+	vertices.nz = block + 5*count_vertices;
+
+	row_bounds = (Bounds *)p;
+	p += Arena::rounded(rows*sizeof(Bounds));
+	col_bounds = (Bounds *)p;
+	p += Arena::rounded(cols*sizeof(Bounds));
+
+	moved = (unsigned char *)p;
+	p += Arena::rounded(count_vertices);
+
+	mesh = (Triangle *)p;
+}
+
+void Balloon::attach(int segments, int pies, bool color, char *storage, double bound)
+{
+	release();
+
+	this->segments = segments;
+	this->pies = pies;
+	this->color = color;
+	this->storage = storage;
+	this->bound = bound;
+
+	// the mesh is there already, the angles only for a reset
+	const Tessellation& T = tessellation(segments, pies, color);
+	delete[] angles;
+	angles = 0;
+	ring = T.ring;
+	col_sin = T.col_sin;
+	col_cos = T.col_cos;
+	adaptive = false;
+
+	carve();
+
+	setup_complete = true;
+}
+
+void Balloon::setup(int segments, int pies, bool color, Arena *arena)
+{
+	prepare(segments, pies, color, arena);
+
+	// the unit sphere for these numbers - only scaled and moved here
+	const Tessellation& T = tessellation(segments, pies, color);
+	delete[] angles;
+	angles = 0;
+	ring = T.ring;
+	col_sin = T.col_sin;
+	col_cos = T.col_cos;
+	adaptive = false;
+
+	build();
+}
+
+void Balloon::setup_refined(int segments, int pies, bool color,
+							const double *ring, const double *col_sin, const double *col_cos, Arena *arena)
+{
+	prepare(segments, pies, color, arena);
+
+	// a copy of the angles, reset needs them again
+	double *own_angles = new double[(segments + 1) + 2*(pies + 1)];
+	memcpy(own_angles, ring, (segments + 1)*sizeof(double));
+	memcpy(own_angles + segments + 1, col_sin, (pies + 1)*sizeof(double));
+	memcpy(own_angles + segments + 1 + pies + 1, col_cos, (pies + 1)*sizeof(double));
+
+	delete[] angles;
+	angles = own_angles;
+	this->ring = angles;
+	this->col_sin = angles + segments + 1;
+	this->col_cos = angles + segments + 1 + pies + 1;
+	adaptive = true;
+
+	build();
+}
+
+void Balloon::reset()
+{
+	build();
+}
+
+void Balloon::prepare(int segments, int pies, bool color, Arena *arena)
+{
+	// the same lattice again (deform_all starts over like this) - keep the memory
+	if (!(setup_complete && this->segments == segments && this->pies == pies))
 	{
-		delete[] mesh;
-		delete[] point_list;
+		release();
+
+		size_t bytes = storage_size(segments, pies);
+		if (arena) storage = (char *)arena->alloc(bytes);
+		if (!storage)
+		{
+			own.reserve(bytes);
+			storage = (char *)own.alloc(bytes);
+		}
 	}
+
+	this->segments = segments;
+	this->pies = pies;
+	this->color = color;
 }
 
-Balloon::setup(int segments, int pies, bool color)
+void Balloon::build()
 {
-	count = 2*segments*pies;
-	mesh = new Triangle[count];
-	
-	Point A;
-	Point B;
-	Point C;
-	Point D;
-	
-	// now build the triangles of each sphere
+	carve();
+	memset(moved, 0, count_vertices);
+
+	ThreadPool& pool = thread_pool();
+	std::mutex lock;
+
+	// now build the vertices of the sphere - row by row, every row gets
+	// its box, the farthest vertex gives the bounding sphere
 	// undeformed now.
-	double ytemp; double rtemp;
-	int k = 0;
-	int i; int j;
-	
-	for (i = 1; i <= segments; i++)
+	bound = 0;
+	pool.parallel_for(rows, 4, [&](int first, int last)
 	{
-		for (j = 0; j < pies; j++)
+		double far = 0;
+
+		for (int i = first; i < last; i++)
 		{
-			ytemp = radius*cos(PI*i/segments);
-			rtemp = sqrt((radius*radius)-(ytemp*ytemp));
-			
-			A.x = x + (rtemp*sin(2*PI*j/pies));
-			A.y =  y + ytemp;
-			A.z = z + (rtemp*cos(2*PI*j/pies));
-			
-			A.nx = A.x / radius;
-			A.ny = A.y / radius;
-			A.nz = A.z / radius;
-			
-			A.R = 1.0;
-			A.G = 1.0;
-			A.B = 1.0;
-			A.A = 1.0;
-			
-			if (color && (j%2 == i%2))
-			{
-				A.R = .2;
-				A.G = .2;
-			}
-			
-			ytemp = radius*cos(PI*(i-1)/segments);
-			rtemp = sqrt((radius*radius)-(ytemp*ytemp));
-			
-			B.x = x + (rtemp*sin(2*PI*j/pies));
-			B.y = y + ytemp;
-			B.z = z + (rtemp*cos(2*PI*j/pies));
-			
-			B.nx = B.x / radius;
-			B.ny = B.y / radius;
-			B.nz = B.z / radius;
-			
-			B.R = 1.0;
-			B.G = 1.0;
-			B.B = 1.0;
-			B.A = 1.0;
-			
-			if (color && (j%2 == i%2))
+			double ytemp = radius*ring[i];
+			double rtemp = sqrt((radius*radius)-(ytemp*ytemp));
+
+			// plain loops over the row, the compiler vectorizes them
+			real *vx = vertices.x + i*cols, *vy = vertices.y + i*cols, *vz = vertices.z + i*cols;
+			real *nx = vertices.nx + i*cols, *ny = vertices.ny + i*cols, *nz = vertices.nz + i*cols;
+			int j;
+
+			for (j = 0; j < cols; j++)
 			{
-				B.R = .2;
-				B.G = .2;
+				vx[j] = x + (rtemp*col_sin[j]);
+				vy[j] = y + ytemp;
+				vz[j] = z + (rtemp*col_cos[j]);
 			}
-			
-			ytemp = radius*cos(PI*i/segments);
-			rtemp = sqrt((radius*radius)-(ytemp*ytemp));
-			
-			C.x = x + (rtemp*sin(2*PI*(j+1)/pies));
-			C.y = y + ytemp;
-			C.z = z + (rtemp*cos(2*PI*(j+1)/pies));
-			
-			C.nx = C.x / radius;
-			C.ny = C.y / radius;
-			C.nz = C.z / radius;
-			
-			C.R = 1.0;
-			C.G = 1.0;
-			C.B = 1.0;
-			C.A = 1.0;
-			
-			if (color && (j%2 == i%2))
+			for (j = 0; j < cols; j++)
 			{
-				C.R = .2;
-				C.G = .2;
+				nx[j] = vx[j] / radius;
+				ny[j] = vy[j] / radius;
+				nz[j] = vz[j] / radius;
 			}
-			
-			ytemp = radius*cos(PI*(i-1)/segments);
-			rtemp = sqrt((radius*radius)-(ytemp*ytemp));
-			
-			D.x = x + (rtemp*sin(2*PI*(j+1)/pies));
-			D.y = y + ytemp;
-			D.z = z + (rtemp*cos(2*PI*(j+1)/pies));
-			
-			D.nx = D.x / radius;
-			D.ny = D.y / radius;
-			D.nz = D.z / radius;
-			
-			D.R = 1.0;
-			D.G = 1.0;
-			D.B = 1.0;
-			D.A = 1.0;
-			
-			if (color && (j%2 == i%2))
+
+			bounds_empty(row_bounds[i]);
+			for (j = 0; j < cols; j++)
 			{
-				D.R = .2;
-				D.G = .2;
+				bounds_extend(row_bounds[i], vx[j], vy[j], vz[j]);
+
+				double d = sqrt((vx[j]-x)*(vx[j]-x) + (vy[j]-y)*(vy[j]-y) + (vz[j]-z)*(vz[j]-z));
+				if (d > far) far = d;
 			}
-			
-			mesh[k].A = A; mesh[k].B = C; mesh[k++].C = B;
-			mesh[k].A = C; mesh[k].B = D; mesh[k++].C = B;
 		}
-	}
-	
-	
-	// create point list
-	count_point_list = 3*count;
-	point_list = new Point[count_point_list];
-	
-	int cur = 0;
-	for (i = 0; i < count; i++)
+
+		reduce_max(bound, far, lock);
+	});
+
+	// boxes around the columns
+	pool.parallel_for(cols, 16, [&](int first, int last)
 	{
-		point_list[cur++] = mesh[i].A;
-		point_list[cur++] = mesh[i].B;
-		point_list[cur++] = mesh[i].C;
-	}
-	
+		for (int j = first; j < last; j++)
+		{
+			bounds_empty(col_bounds[j]);
+			for (int k = j; k < count_vertices; k += cols)
+				bounds_extend(col_bounds[j], vertices.x[k], vertices.y[k], vertices.z[k]);
+		}
+	});
+
+	// and the triangles - the same for every lattice of these numbers,
+	// refined ones have numbers of their own and are not worth caching
+	if (adaptive) lattice_triangles(segments, pies, color, mesh);
+	else memcpy(mesh, tessellation(segments, pies, color).mesh, count*sizeof(Triangle));
+
+
 	setup_complete = true;
 }
 
-Balloon::deform(Balloon& Other)
+int Balloon::deform(Balloon& Other)
 {
 	// check if pressure correct (if == 0 -> do nothing)
 	if (pressure + Other.pressure == 0) return 0;
@@ -177,144 +321,352 @@ Balloon::deform(Balloon& Other)
 	double Vz = z - Other.z;
 	
 	// check the distance (if greter than the sum of radii -> ok, else deform)
-//	double dist = sqrt((Vx*Vx) + (Vy*Vy) + (Vz*Vz));
-	
-//	if (dist > (radius + Other.radius)) return 0; // distance big enough
+	double dist = sqrt((Vx*Vx) + (Vy*Vy) + (Vz*Vz));
 	
-	delete[] point_list;
+	if (dist > (bound + Other.radius)*(1 + REAL_SLACK)) return 0; // distance big enough
 	
+	// only the bands touching the other balloon can have vertices inside it
+	int first_row = rows, last_row = -1;
+	int first_col = cols, last_col = -1;
+	int i, j;
+
+	for (i = 0; i < rows; i++)
+	{
+		if (bounds_touch(row_bounds[i], Other.x, Other.y, Other.z, Other.radius))
+		{
+			if (i < first_row) first_row = i;
+			last_row = i;
+		}
+	}
+	for (j = 0; j < cols; j++)
+	{
+		if (bounds_touch(col_bounds[j], Other.x, Other.y, Other.z, Other.radius))
+		{
+			if (j < first_col) first_col = j;
+			last_col = j;
+		}
+	}
+	if (last_row < 0 || last_col < 0) return 0;
+
+	DeformParams p;
+	p.ox = Other.x; p.oy = Other.y; p.oz = Other.z;
+	p.radius = Other.radius;
+	p.Vx = Vx; p.Vy = Vy; p.Vz = Vz;
+	p.a = Vx*Vx + Vy*Vy + Vz*Vz;
+	p.f = Other.pressure/(pressure+Other.pressure);
+
+	unsigned char *col_touches = new unsigned char[cols];
+	for (j = 0; j < cols; j++)
+		col_touches[j] = bounds_touch(col_bounds[j], Other.x, Other.y, Other.z, Other.radius);
+
 	// change all vertices "behind" the deformation plane
-	int c_this = 0;
-	double c_x = 0; double c_y = 0; double c_z = 0;
-	double d = 0;
-	
-	double Ix, Iy, Iz;
-	
-	for (int i = 0; i < count; i++)
+	// each vertex is shared by several triangles - move it only once
+	std::atomic<int> count_moved(0);
+	STATS(DeformCounts counts = { 0, 0, 0 };)
+	STATS(std::mutex counts_lock;)
+
+	thread_pool().parallel_for(last_row - first_row + 1, 2, [&](int first, int last)
 	{
-		// if vertex inside 2nd balloon -> add to c_xyz
-		Point A, B, C;
-		Point P;
-		
-		// choosing vertex
-		
-		A = mesh[i].A;
-		B = mesh[i].B;
-		C = mesh[i].C;
-		
-		for (int ver = 0; ver < 3; ver++)
+		int moved_here = 0;
+		STATS(DeformCounts here = { 0, 0, 0 };)
+
+		for (int i = first_row + first; i < first_row + last; i++)
 		{
-			switch(ver)
-			{
-			case 0:
-				P = A;
-				break;
-			case 1:
-				P = B;
-				break;
-			case 2:
-			default:
-				P = C;
-				break;
-			}
-			
-			d = sqrt((P.x - Other.x)*(P.x - Other.x) + 
-				(P.y - Other.y)*(P.y - Other.y) + 
-				(P.z - Other.z)*(P.z - Other.z));
-			
-			if (d < Other.radius)
+			if (!bounds_touch(row_bounds[i], Other.x, Other.y, Other.z, Other.radius)) continue;
+
+			// runs of touching columns in this row
+			int j = first_col;
+			while (j <= last_col)
 			{
-				double a = Vx*Vx + Vy*Vy + Vz*Vz;
-				
-				double b = Vx*(P.x-Other.x) + Vy*(P.y-Other.y) + Vz*(P.z-Other.z);
-				
-				double c = (P.x-Other.x)*(P.x-Other.x) + 
-					(P.y-Other.y)*(P.y-Other.y) + 
-					(P.z-Other.z)*(P.z-Other.z) - 
-					Other.radius*Other.radius;
-				double D = b*b-a*c;
-				
-				if (D < 0) ; // error
-				else
+				if (!col_touches[j])
 				{
-					double t2 = (-sqrt(D) - b)/a;
-					double t1 = (sqrt(D) - b)/a;
-					double t;
-					
-					if (t2 > 0)
-						t = t2;
-					else if (t1 > 0)
-						t = t1;
-					else
-						t = 0;
-					
-					Ix = P.x + t*Vx;
-					Iy = P.y + t*Vy;
-					Iz = P.z + t*Vz;
+					j++;
+					continue;
 				}
-				// move point in direction S1->S2 distance  r2/(r1+r2)*width of intersection
-				
-				double Dx = P.x + (Ix-P.x) * (Other.pressure/(pressure+Other.pressure));
-				double Dy = P.y + (Iy-P.y) * (Other.pressure/(pressure+Other.pressure));
-				double Dz = P.z + (Iz-P.z) * (Other.pressure/(pressure+Other.pressure));
-				
-				P.x = Dx;
-				P.y = Dy;
-				P.z = Dz;
-				
-				switch (ver)
-				{
-				case 0:
-					A = P;
-					break;
-				case 1:
-					B = P;
-					break;
-				case 2:
-				default:
-					C = P;
-					break;
-				} // of switch
-				
-			} // of if dist 
-			
-		} // of for vertices
-		
-		
-		// set normal vectors
-		double ux = B.x - A.x;
-		double uy = B.y - A.y;
-		double uz = B.z - A.z;
-		
-		double vx = C.x - A.x;
-		double vy = C.y - A.y;
-		double vz = C.z - A.z;
-		
-		double nx = uy*vz - uz*vy;
-		double ny = uz*vx - ux*vz;
-		double nz = ux*vy - uy*vx;
-		double dn = sqrt(nx*nx + ny*ny + nz*nz);
-		
-		A.nx = nx/dn; A.ny = ny/dn; A.nz = nz/dn;
-		B.nx = nx/dn; B.ny = ny/dn; B.nz = nz/dn;
-		C.nx = nx/dn; C.ny = ny/dn; C.nz = nz/dn;
+				int run = j;
+				while (j <= last_col && col_touches[j]) j++;
+
+				moved_here += deform_vertices(vertices.x, vertices.y, vertices.z,
+					i*cols + run, i*cols + j, p, moved, STATS_COUNTS(&here));
+			}
+		}
+
+		count_moved += moved_here;
+
+		STATS(std::lock_guard<std::mutex> guard(counts_lock);)
+		STATS(add_counts(counts, here);)
+	});
+
+	delete[] col_touches;
+	STATS(stats_add(this, &Other, counts);)
+
+	if (count_moved == 0) return 0;
+
+	finish_deform(first_row, last_row, first_col, last_col);
 		
-		mesh[i].A = A;
-		mesh[i].B = B;
-		mesh[i].C = C;
+	return 0;
+}
+
+int Balloon::deform(const Balloon* others, int n)
+{
+	const Balloon **list = new const Balloon*[n];
+	for (int i = 0; i < n; i++) list[i] = others + i;
+
+	deform(list, n);
+
+	delete[] list;
+	return 0;
+}
 
-	} // of for all triangles
+int Balloon::deform(const Balloon* const* others, int n)
+{
+	// parameters of all deformers
+	DeformParams *params = new DeformParams[n];
+	Sphere *spheres = new Sphere[n];
+	int used = 0;
+	int i;
+
+	// which deformer every used one is, and what it did
+	STATS(std::vector<int> index(n);)
+	STATS(std::vector<DeformCounts> counts(n);)
+
+	for (i = 0; i < n; i++)
+	{
+		const Balloon& Other = *others[i];
+
+		// check if pressure correct (if == 0 -> do nothing)
+		if (pressure + Other.pressure == 0) continue;
+
+		// no bounding sphere test here - earlier deformers can still push
+		// vertices out into this one, the grid keeps the work local anyway
+		double Vx = x - Other.x;
+		double Vy = y - Other.y;
+		double Vz = z - Other.z;
+
+		DeformParams& p = params[used];
+		p.ox = Other.x; p.oy = Other.y; p.oz = Other.z;
+		p.radius = Other.radius;
+		p.Vx = Vx; p.Vy = Vy; p.Vz = Vz;
+		p.a = Vx*Vx + Vy*Vy + Vz*Vz;
+		p.f = Other.pressure/(pressure+Other.pressure);
 
-	point_list = new Point[count_point_list];
+		spheres[used].x = Other.x;
+		spheres[used].y = Other.y;
+		spheres[used].z = Other.z;
+		// a little slack - the kernel compares sqrt(d2) < radius
+		spheres[used].radius = Other.radius*(1 + REAL_SLACK);
 
-	int cur = 0;
+		STATS(index[used] = i;)
+		used++;
+	}
 
-	for (int j = 0; j < count; j++)
+	// box around the whole balloon - the grid only needs to cover it
+	Bounds box = row_bounds[0];
+	for (i = 1; i < rows; i++)
 	{
-		point_list[cur++] = mesh[j].A;
-		point_list[cur++] = mesh[j].B;
-		point_list[cur++] = mesh[j].C;
+		if (row_bounds[i].min_x < box.min_x) box.min_x = row_bounds[i].min_x;
+		if (row_bounds[i].min_y < box.min_y) box.min_y = row_bounds[i].min_y;
+		if (row_bounds[i].min_z < box.min_z) box.min_z = row_bounds[i].min_z;
+		if (row_bounds[i].max_x > box.max_x) box.max_x = row_bounds[i].max_x;
+		if (row_bounds[i].max_y > box.max_y) box.max_y = row_bounds[i].max_y;
+		if (row_bounds[i].max_z > box.max_z) box.max_z = row_bounds[i].max_z;
 	}
-		
+
+	SphereGrid grid;
+	grid.build(spheres, used, box);
+
+	int first_row = rows, last_row = -1;
+	int first_col = cols, last_col = -1;
+	std::mutex lock;
+
+	thread_pool().parallel_for(count_vertices, 1024, [&](int first, int last)
+	{
+		int rows_from = rows, rows_to = -1;
+		int cols_from = cols, cols_to = -1;
+		STATS(std::vector<DeformCounts> here(used);)
+
+		for (int i = first; i < last; i++)
+		{
+			// deformers in file order; after a move the vertex may be in
+			// another cell, so look it up again and go on after the last one
+			int after = -1;
+			int c = grid.cell(vertices.x[i], vertices.y[i], vertices.z[i]);
+
+			while (c >= 0)
+			{
+				int count_items;
+				const int *items = grid.items(c, count_items);
+				int next_cell = -1;
+
+				for (int j = 0; j < count_items; j++)
+				{
+					int k = items[j];
+					if (k <= after) continue;
+
+					after = k;
+
+					// cheap reject before the exact test
+					const Sphere& S = spheres[k];
+					double dx = vertices.x[i] - S.x;
+					double dy = vertices.y[i] - S.y;
+					double dz = vertices.z[i] - S.z;
+					if (dx*dx + dy*dy + dz*dz > S.radius*S.radius) continue;
+
+					if (deform_vertex(vertices.x, vertices.y, vertices.z, i, params[k], moved, STATS_COUNTS(&here[k])))
+					{
+						next_cell = grid.cell(vertices.x[i], vertices.y[i], vertices.z[i]);
+						break;
+					}
+				}
+				c = next_cell;
+			}
+
+			if (moved[i])
+			{
+				int row = i / cols, col = i % cols;
+				if (row < rows_from) rows_from = row;
+				if (row > rows_to) rows_to = row;
+				if (col < cols_from) cols_from = col;
+				if (col > cols_to) cols_to = col;
+			}
+		}
+
+		// the range of moved vertices does not depend on the chunk order
+		std::lock_guard<std::mutex> guard(lock);
+		if (rows_from < first_row) first_row = rows_from;
+		if (rows_to > last_row) last_row = rows_to;
+		if (cols_from < first_col) first_col = cols_from;
+		if (cols_to > last_col) last_col = cols_to;
+
+		STATS(for (int k = 0; k < used; k++) add_counts(counts[k], here[k]);)
+	});
+
+	STATS(for (i = 0; i < used; i++) stats_add(this, others[index[i]], counts[i]);)
+
+	if (last_row >= 0)
+		finish_deform(first_row, last_row, first_col, last_col);
+
+	delete[] params;
+	delete[] spheres;
+
 	return 0;
-}
\ No newline at end of file
+}
+
+void Balloon::finish_deform(int first_row, int last_row, int first_col, int last_col)
+{
+	ThreadPool& pool = thread_pool();
+	std::mutex lock;
+
+	// grow the bands and the bounding sphere by the moved vertices
+	// rows and columns separately, so no box is shared between threads
+	pool.parallel_for(last_row - first_row + 1, 8, [&](int first, int last)
+	{
+		double far = 0;
+
+		for (int i = first_row + first; i < first_row + last; i++)
+		{
+			for (int j = first_col; j <= last_col; j++)
+			{
+				int k = i*cols + j;
+				if (!moved[k]) continue;
+
+				double vx = vertices.x[k], vy = vertices.y[k], vz = vertices.z[k];
+				bounds_extend(row_bounds[i], vx, vy, vz);
+
+				double d = sqrt((vx-x)*(vx-x) + (vy-y)*(vy-y) + (vz-z)*(vz-z));
+				if (d > far) far = d;
+			}
+		}
+
+		reduce_max(bound, far, lock);
+	});
+
+	pool.parallel_for(last_col - first_col + 1, 8, [&](int first, int last)
+	{
+		for (int j = first_col + first; j < first_col + last; j++)
+		{
+			for (int k = first_row*cols + j; k <= last_row*cols + j; k += cols)
+			{
+				if (moved[k])
+					bounds_extend(col_bounds[j], vertices.x[k], vertices.y[k], vertices.z[k]);
+			}
+		}
+	});
+
+	// renormalize only the triangles of the quads around moved vertices
+	// quad (i, j) has the corners (i, j) (i-1, j) (i, j+1) (i-1, j+1)
+	int first_quad_row = first_row > 1 ? first_row : 1;
+	int last_quad_row = last_row + 1 < rows - 1 ? last_row + 1 : rows - 1;
+	int first_quad_col = first_col > 1 ? first_col - 1 : 0;
+	int last_quad_col = last_col < cols - 2 ? last_col : cols - 2;
+	STATS(std::atomic<long long> renormalized(0);)
+
+	pool.parallel_for(last_quad_row - first_quad_row + 1, 4, [&](int first, int last)
+	{
+		STATS(long long here = 0;)
+
+		for (int i = first_quad_row + first; i < first_quad_row + last; i++)
+		{
+			for (int j = first_quad_col; j <= last_quad_col; j++)
+			{
+				int k = i*cols + j;
+				if (!(moved[k] | moved[k + 1] | moved[k - cols] | moved[k - cols + 1])) continue;
+
+				int t = 2*((i-1)*(cols-1) + j);
+				update_normal(t);
+				update_normal(t + 1);
+				STATS(here += 2;)
+			}
+		}
+
+		STATS(renormalized += here;)
+	});
+
+	STATS(stats_renormalized(this, renormalized);)
+
+	// clear the flags for the next call
+	for (int i = first_row; i <= last_row; i++)
+		memset(moved + i*cols + first_col, 0, last_col - first_col + 1);
+}
+
+void Balloon::update_normal(int triangle)
+{
+	Triangle& T = mesh[triangle];
+	int A = T.a, B = T.b, C = T.c;
+	
+	// set normal vectors
+	double ux = vertices.x[B] - vertices.x[A];
+	double uy = vertices.y[B] - vertices.y[A];
+	double uz = vertices.z[B] - vertices.z[A];
+	
+	double vx = vertices.x[C] - vertices.x[A];
+	double vy = vertices.y[C] - vertices.y[A];
+	double vz = vertices.z[C] - vertices.z[A];
+	
+	double nx = uy*vz - uz*vy;
+	double ny = uz*vx - ux*vz;
+	double nz = ux*vy - uy*vx;
+	double dn = sqrt(nx*nx + ny*ny + nz*nz);
+	
+	T.nx = nx/dn; T.ny = ny/dn; T.nz = nz/dn;
+	T.flat = true;
+}
+
+void Balloon::corner(int triangle, int which, Point& P) const
+{
+	const Triangle& T = mesh[triangle];
+	int v = (which == 0 ? T.a : (which == 1 ? T.b : T.c));
+
+	P.x = vertices.x[v]; P.y = vertices.y[v]; P.z = vertices.z[v];
+
+	if (T.flat)
+	{
+		P.nx = T.nx; P.ny = T.ny; P.nz = T.nz;
+	}
+	else
+	{
+		P.nx = vertices.nx[v]; P.ny = vertices.ny[v]; P.nz = vertices.nz[v];
+	}
+
+	P.R = T.R; P.G = T.G; P.B = T.B; P.A = T.A;
+}
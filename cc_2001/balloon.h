@@ -1,23 +1,65 @@
+#ifndef BALLOON_H
+#define BALLOON_H
+
+#include "arena.h"
+#include "real.h"
+
 struct Point
 {
 	// DATA
 
 public:
 	// Position in space
-	double x, y, z;
+	real x, y, z;
 
 	// Normal
-	double nx, ny, nz;
-	
+	real nx, ny, nz;
+
 	// Color
-	double R, G, B, A;
+	real R, G, B, A;
 };
 
+struct Vertices
+{
+	// Positions in space - one array per coordinate so that
+	// the deform kernel can process several vertices at once
+	real *x, *y, *z;
+
+	// Normals (of the undeformed sphere)
+	real *nx, *ny, *nz;
+};
+
+struct Bounds
+{
+	// axis aligned box
+	real min_x, min_y, min_z;
+	real max_x, max_y, max_z;
+};
+
+// box helpers
+void bounds_empty(Bounds& b);
+void bounds_extend(Bounds& b, double x, double y, double z);
+
+// can a point of the box lie inside the sphere?
+bool bounds_touch(const Bounds& b, double x, double y, double z, double radius);
+
 struct Triangle
 {
-	Point A, B, C;
+	// indices into the vertex buffer
+	int a, b, c;
+
+	// true after deform - use the face normal instead of the vertex normals
+	bool flat;
+
+	// face normal
+	real nx, ny, nz;
+
+	// Color
+	real R, G, B, A;
 };
 
+class Corners;
+
 class Balloon
 {
 public:
@@ -31,13 +73,44 @@ public:
 	double radius;
 	double pressure;
 
-	// triangles
+	// shared vertices of the lattice - rows (= segments + 1) of cols (= pies + 1)
+	Vertices vertices;
+	int count_vertices;
+	int rows, cols;
+
+	// boxes around every row (latitude band) and every column (longitude
+	// band) of the lattice, they only grow when vertices move
+	Bounds *row_bounds;
+	Bounds *col_bounds;
+
+	// no vertex is further than this from the center
+	double bound;
+
+	// scratch flags for deform, all zero between calls
+	unsigned char *moved;
+
+	// triangles (indexed)
 	Triangle *mesh;
 	int count;
 
-	Point *point_list;
-	int count_point_list;
 
+	// how the triangles were set up
+	int segments, pies;
+	bool color;
+
+	// the rows and columns of the lattice: per row the cos of the angle
+	// from the top, per column sin and cos around the axis. the
+	// tessellation's, or a copy of the ones given to setup_refined.
+	const double *ring, *col_sin, *col_cos;
+
+	// set up with its own angles (setup_refined), not the evenly spaced
+	// unit sphere of the tessellation
+	bool adaptive;
+
+	// all the arrays above live in one piece of memory - from the scene
+	// arena given to setup, the balloon's own one or attached from outside
+	char *storage;
+	Arena own;
 
 	bool setup_complete;
 public:
@@ -49,9 +122,119 @@ public:
 	// destructor
 	~Balloon();
 
-	// setup triangles
-	setup(int segments, int pies, bool color);
+	// setup triangles - in a piece of arena if there is one with enough room.
+	// a second setup with the same segments and pies reuses the memory.
+	void setup(int segments, int pies, bool color, Arena *arena = 0);
+
+	// setup on a lattice with its own spacing: ring[segments + 1],
+	// col_sin[pies + 1] and col_cos[pies + 1] as in Tessellation (see refine.h)
+	void setup_refined(int segments, int pies, bool color,
+					   const double *ring, const double *col_sin, const double *col_cos, Arena *arena = 0);
+
+	// the undeformed balloon again, on the lattice of the last setup
+	void reset();
+
+	// bytes setup takes from the arena
+	static size_t storage_size(int segments, int pies);
+
+	// false if a lattice this size cannot be indexed with ints or its
+	// storage_size does not fit in a size_t
+	static bool lattice_fits(int segments, int pies);
+
+	// use storage_size bytes laid out by an earlier setup (and deform) of
+	// a balloon at the same place - no computing at all. the memory stays
+	// the caller's and must have the moved flags cleared.
+	void attach(int segments, int pies, bool color, char *storage, double bound);
 
 	// press against other balloon
-	deform( Balloon& );
-};
\ No newline at end of file
+	int deform( Balloon& );
+
+	// press against n other balloons at once - same result as calling
+	// deform(others[i]) for i = 0 .. n-1, but in one pass over the vertices
+	int deform( const Balloon* others, int n );
+
+	// the same for balloons which are not next to each other
+	int deform( const Balloon* const* others, int n );
+
+	// vertex of a triangle as it should be drawn
+	void corner(int triangle, int which, Point& P) const;
+
+	// all of them in drawing order
+	Corners corners() const;
+
+private:
+	friend class Deformation;
+
+	// the own angles of setup_refined
+	double *angles;
+
+	// free the triangles of an earlier setup
+	void release();
+
+	// storage for a lattice of these numbers
+	void prepare(int segments, int pies, bool color, Arena *arena);
+
+	// vertices, bounds and triangles of the undeformed balloon
+	void build();
+
+	// point the arrays into storage
+	void carve();
+
+	// recompute the face normal of one triangle
+	void update_normal(int triangle);
+
+	// grow the bounds, renormalize the triangles around the moved vertices
+	// and clear their flags. only rows/cols in the given ranges are checked.
+	void finish_deform(int first_row, int last_row, int first_col, int last_col);
+};
+
+// the corners of all the triangles, three per triangle, as a list to draw
+// or write out. nothing is copied - every corner is read from the vertices
+// and triangles of the balloon when it is asked for.
+class Corners
+{
+public:
+	Corners(const Balloon& balloon) : balloon(balloon) {}
+
+	int size() const { return 3*balloon.count; }
+
+	Point operator[](int i) const
+	{
+		Point P;
+		balloon.corner(i / 3, i % 3, P);
+		return P;
+	}
+
+	class iterator
+	{
+	public:
+		iterator(const Balloon& balloon, int i) : balloon(&balloon), i(i) {}
+
+		Point operator*() const
+		{
+			Point P;
+			balloon->corner(i / 3, i % 3, P);
+			return P;
+		}
+		iterator& operator++() { i++; return *this; }
+		bool operator==(const iterator& other) const { return i == other.i; }
+		bool operator!=(const iterator& other) const { return i != other.i; }
+
+	private:
+		const Balloon *balloon;
+		int i;
+	};
+
+	iterator begin() const { return iterator(balloon, 0); }
+	iterator end() const { return iterator(balloon, size()); }
+
+private:
+	const Balloon& balloon;
+};
+
+inline Corners Balloon::corners() const
+{
+	return Corners(*this);
+}
+
+#endif
@@ -0,0 +1,279 @@
+// balloon-batch: the model without a window.
+// reads a .bal file, sets up and deforms the balloons, writes the mesh
+// and reports how long every phase took.
+
+#include "scene.h"
+#include "export.h"
+#include "raster.h"
+#include "png.h"
+#include "threadpool.h"
+#include "stats.h"
+#include "sweep.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: balloon-batch [options] filename.bal\n"
+		"  -all          deform all the balloons, not only the object\n"
+		"  -adaptive n   n times coarser away from the contacts (see refine.h)\n"
+		"  -threads n    number of threads (0 = one per core)\n"
+		"  -o file       write the deformed meshes (.obj .ply .stl or .raw)\n"
+		"                or the whole scene with them (.balb)\n"
+		"  -nomesh       only the balloons in the .balb, no meshes\n"
+		"  -stats file   write the deformation counters and phase times as JSON\n"
+		"  -png file     draw the scene like the viewer into a .png (no OpenGL)\n"
+		"  -size WxH     size of the picture (640x480)\n"
+		"  -vary b.field from:to:steps\n"
+		"                deform every combination of the values instead of the\n"
+		"                file's (field x y z radius or pressure of balloon b),\n"
+		"                -o then needs a %%d for the number of the variant\n"
+		"  -metrics file write the values, volume, bound and time of every\n"
+		"                variant as JSON\n"
+		"  -check        compare the object of every variant with a fresh\n"
+		"                setup and deformation (not with -all)\n");
+}
+
+// milliseconds since start
+static double elapsed(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// true if pattern has exactly one %d and no other %
+static bool variant_pattern(const char *pattern)
+{
+	int count = 0;
+	for (const char *p = strchr(pattern, '%'); p; p = strchr(p + 2, '%'))
+	{
+		if (p[1] != 'd') return false;
+		count++;
+	}
+	return count == 1;
+}
+
+// -vary: the variants of the scene instead of the scene
+static int sweep(const Scene& scene, const std::vector<SweepRange>& ranges, bool everything,
+				 const char *input, const char *output, const char *metrics, bool check, double read_ms)
+{
+	Sweep variants(scene, &ranges[0], (int)ranges.size());
+	std::atomic<bool> failed(false);
+	std::atomic<int> mismatches(0);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	variants.run(everything, [&](int v, const Balloon *balloons, int count)
+	{
+		if (check && !deformation_matches(balloons, count, scene.segments, scene.pies, scene.object_color))
+		{
+			fprintf(stderr, "balloon-batch: variant %d differs from a fresh deformation\n", v);
+			mismatches++;
+		}
+
+		if (!output) return;
+
+		char name[1024];
+		snprintf(name, sizeof(name), output, v);
+		if (!write_mesh(name, balloons, count))
+		{
+			fprintf(stderr, "balloon-batch: cannot write %s\n", name);
+			failed = true;
+		}
+	});
+	double sweep_ms = elapsed(start);
+
+	if (failed) return 1;
+
+	printf("%s: %d balloons, %d variants, threads: %d\n", input, scene.count, variants.variants(), thread_count());
+	printf("read    %10.3f ms\n", read_ms);
+	printf("sweep   %10.3f ms (%.1f variants/s)\n", sweep_ms, 1000*variants.variants()/sweep_ms);
+	if (check) printf("check   %d of %d variants differ\n", (int)mismatches, variants.variants());
+
+	if (metrics)
+	{
+		FILE *stream = fopen(metrics, "wt");
+		if (!stream)
+		{
+			fprintf(stderr, "balloon-batch: cannot write %s\n", metrics);
+			return 1;
+		}
+		write_sweep_json(stream, variants, sweep_ms);
+		fclose(stream);
+	}
+
+	return mismatches ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	bool everything = false;
+	bool meshes = true;
+	int coarse = 0;
+	const char *output = 0;
+	const char *stats_output = 0;
+	const char *picture = 0;
+	int width = 640, height = 480;
+	const char *input = 0;
+	std::vector<SweepRange> ranges;
+	const char *metrics = 0;
+	bool check = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-all") == 0) everything = true;
+		else if (strcmp(argv[i], "-adaptive") == 0 && i + 1 < argc) coarse = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) set_thread_count(atoi(argv[++i]));
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) output = argv[++i];
+		else if (strcmp(argv[i], "-nomesh") == 0) meshes = false;
+		else if ((strcmp(argv[i], "-stats") == 0 || strcmp(argv[i], "--stats") == 0) && i + 1 < argc) stats_output = argv[++i];
+		else if (strcmp(argv[i], "-png") == 0 && i + 1 < argc) picture = argv[++i];
+		else if (strcmp(argv[i], "-size") == 0 && i + 1 < argc)
+		{
+			if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width < 1 || height < 1)
+			{
+				usage();
+				return 2;
+			}
+		}
+		else if (strcmp(argv[i], "-vary") == 0 && i + 2 < argc)
+		{
+			SweepRange range;
+			if (!sweep_range(argv[i + 1], argv[i + 2], range))
+			{
+				fprintf(stderr, "balloon-batch: -vary %s %s: not a range\n", argv[i + 1], argv[i + 2]);
+				return 2;
+			}
+			ranges.push_back(range);
+			i += 2;
+		}
+		else if (strcmp(argv[i], "-metrics") == 0 && i + 1 < argc) metrics = argv[++i];
+		else if (strcmp(argv[i], "-check") == 0) check = true;
+		else if (argv[i][0] == '-' || input)
+		{
+			usage();
+			return 2;
+		}
+		else input = argv[i];
+	}
+
+	if (!input)
+	{
+		usage();
+		return 2;
+	}
+
+	Scene scene;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if (!scene.read(input))
+	{
+		fprintf(stderr, "balloon-batch: %s\n", scene.error());
+		return 1;
+	}
+	double read_ms = elapsed(start);
+
+	if (!ranges.empty() || metrics || check)
+	{
+		if (ranges.empty() || coarse > 1 || picture || stats_output || (check && everything))
+		{
+			fprintf(stderr, "balloon-batch: -metrics and -check need -vary, -vary does not go with -adaptive, -png or -stats, -check not with -all\n");
+			return 2;
+		}
+		if (output && (!variant_pattern(output) || strstr(output, ".balb")))
+		{
+			fprintf(stderr, "balloon-batch: -o %s: a mesh file name with one %%d for the variant\n", output);
+			return 2;
+		}
+		for (size_t r = 0; r < ranges.size(); r++)
+			if (ranges[r].balloon >= scene.count)
+			{
+				fprintf(stderr, "balloon-batch: -vary: %s has no balloon %d\n", input, ranges[r].balloon);
+				return 2;
+			}
+		if (sweep_variants(&ranges[0], (int)ranges.size()) > SWEEP_MAX_VARIANTS)
+		{
+			fprintf(stderr, "balloon-batch: -vary: more than %d variants\n", SWEEP_MAX_VARIANTS);
+			return 2;
+		}
+		return sweep(scene, ranges, everything, input, output, metrics, check, read_ms);
+	}
+
+	start = std::chrono::steady_clock::now();
+	if (coarse > 1) scene.setup_adaptive(coarse, everything);
+	else scene.setup();
+	double setup_ms = elapsed(start);
+
+	start = std::chrono::steady_clock::now();
+	scene.deform(everything);
+	double deform_ms = elapsed(start);
+
+	double write_ms = 0;
+	if (output)
+	{
+		start = std::chrono::steady_clock::now();
+		size_t n = strlen(output);
+		if (n > 5 && strcmp(output + n - 5, ".balb") == 0)
+		{
+			if (!scene.write(output, meshes))
+			{
+				fprintf(stderr, "balloon-batch: %s\n", scene.error());
+				return 1;
+			}
+		}
+		else if (!write_mesh(output, scene.balloons, scene.count))
+		{
+			fprintf(stderr, "balloon-batch: cannot write %s\n", output);
+			return 1;
+		}
+		write_ms = elapsed(start);
+	}
+
+	double render_ms = 0;
+	if (picture)
+	{
+		start = std::chrono::steady_clock::now();
+		Rasterizer raster(width, height);
+		raster.draw(scene.balloons, scene.count, scene.object_style, scene.around_style);
+		if (!write_png(picture, raster.pixels(), width, height))
+		{
+			fprintf(stderr, "balloon-batch: cannot write %s\n", picture);
+			return 1;
+		}
+		render_ms = elapsed(start);
+	}
+
+	long long vertices = 0, triangles = 0;
+	for (int i = 0; i < scene.count; i++)
+	{
+		vertices += scene.balloons[i].count_vertices;
+		triangles += scene.balloons[i].count;
+	}
+
+	printf("%s: %d balloons, %lld vertices, %lld triangles, threads: %d%s\n",
+		   input, scene.count, vertices, triangles, thread_count(),
+		   scene.cached ? ", meshes from the file" : "");
+	printf("read    %10.3f ms\n", read_ms);
+	printf("setup   %10.3f ms\n", setup_ms);
+	printf("deform  %10.3f ms\n", deform_ms);
+	if (output) printf("write   %10.3f ms\n", write_ms);
+	if (picture) printf("render  %10.3f ms\n", render_ms);
+	printf("total   %10.3f ms\n", read_ms + setup_ms + deform_ms + write_ms + render_ms);
+
+	if (stats_output)
+	{
+		FILE *stream = fopen(stats_output, "wt");
+		if (!stream)
+		{
+			fprintf(stderr, "balloon-batch: cannot write %s\n", stats_output);
+			return 1;
+		}
+		write_stats_json(stream, stats(), scene.balloons, scene.count);
+		fclose(stream);
+	}
+
+	return 0;
+}
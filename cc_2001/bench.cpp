@@ -0,0 +1,293 @@
+// balloon-bench: times setup, deform and export on the sample scenes and
+// on generated ones, writes the results as JSON to compare builds.
+
+#include "scene.h"
+#include "export.h"
+#include "threadpool.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// one measured scene
+struct Result
+{
+	std::string name;
+	int balloons;
+	int segments, pies;
+	long long vertices, triangles;
+	long long deformed;			// vertices of the object, the only one deformed
+
+	// best of the repeats, milliseconds
+	double setup_ms, deform_ms, export_ms;
+
+	long long export_bytes;
+	long long geometry_bytes;	// the scene arena
+};
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: balloon-bench [options]\n"
+		"  -samples dir  directory with the sample scenes (default: samples)\n"
+		"  -o file       write the JSON there instead of to stdout\n"
+		"  -threads n    number of threads (0 = one per core)\n"
+		"  -repeat n     runs per scene, the best one counts (default 3)\n"
+		"  -quick        smaller synthetic scenes\n");
+}
+
+static double since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// largest resident size of the process up to now - one number for the
+// whole run, a scene after a bigger one would only repeat its peak
+static long long peak_kb()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return (long long)(counters.PeakWorkingSetSize / 1024);
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// a scene the same as read from a file: setup, deform of the object,
+// export - every phase timed, repeated on a fresh copy of the balloons
+static void measure(Scene& scene, const char *name, int repeat, const std::string& export_file,
+					std::vector<Result>& results)
+{
+	// the input, to start every run from
+	int n = scene.count;
+	std::vector<double> x(n), y(n), z(n), radius(n), pressure(n);
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		x[i] = scene.balloons[i].x; y[i] = scene.balloons[i].y; z[i] = scene.balloons[i].z;
+		radius[i] = scene.balloons[i].radius; pressure[i] = scene.balloons[i].pressure;
+	}
+
+	Result r;
+	r.name = name;
+	r.balloons = n;
+	r.segments = scene.segments;
+	r.pies = scene.pies;
+	r.setup_ms = r.deform_ms = r.export_ms = 1e300;
+	r.export_bytes = 0;
+
+	for (int run = 0; run < repeat; run++)
+	{
+		// undeformed balloons again
+		delete[] scene.balloons;
+		scene.balloons = new Balloon[n];
+		for (i = 0; i < n; i++)
+		{
+			Balloon& b = scene.balloons[i];
+			b.x = x[i]; b.y = y[i]; b.z = z[i];
+			b.radius = radius[i]; b.pressure = pressure[i];
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		scene.setup();
+		r.setup_ms = std::min(r.setup_ms, since(start));
+
+		start = std::chrono::steady_clock::now();
+		scene.deform(false);
+		r.deform_ms = std::min(r.deform_ms, since(start));
+
+		start = std::chrono::steady_clock::now();
+		write_ply(export_file.c_str(), scene.balloons, n);
+		r.export_ms = std::min(r.export_ms, since(start));
+	}
+
+	std::error_code ignored;
+	r.export_bytes = (long long)std::filesystem::file_size(export_file, ignored);
+	std::filesystem::remove(export_file, ignored);
+
+	r.vertices = r.triangles = 0;
+	for (i = 0; i < n; i++)
+	{
+		r.vertices += scene.balloons[i].count_vertices;
+		r.triangles += scene.balloons[i].count;
+	}
+	r.deformed = scene.balloons[0].count_vertices;
+	r.geometry_bytes = (long long)scene.arena.size();
+
+	results.push_back(r);
+
+	fprintf(stderr, "%-40s %8lld vertices  setup %9.3f ms  deform %9.3f ms  export %9.3f ms\n",
+			name, r.vertices, r.setup_ms, r.deform_ms, r.export_ms);
+}
+
+// object in the middle, n balloons around it on a shell, all pressing it
+static void synthetic(Scene& scene, int n, int segments, int pies)
+{
+	scene.clear();
+	scene.segments = segments;
+	scene.pies = pies;
+	scene.object_color = scene.around_color = true;
+
+	scene.count = n + 1;
+	scene.balloons = new Balloon[n + 1];
+	scene.balloons[0].radius = 2;
+	scene.balloons[0].pressure = 1.1;
+
+	// golden angle spiral - evenly spread, the same for every run
+	for (int i = 1; i <= n; i++)
+	{
+		double t = 1 - 2*(i - .5)/n;
+		double s = sqrt(1 - t*t);
+		double a = 2.39996322972865332*i;
+
+		Balloon& b = scene.balloons[i];
+		b.radius = 4/sqrt((double)n) + .2;
+		b.x = 2.1*s*cos(a); b.y = 2.1*t; b.z = 2.1*s*sin(a);
+		b.pressure = 1;
+	}
+}
+
+static void json_string(FILE *out, const std::string& s)
+{
+	fputc('"', out);
+	for (size_t i = 0; i < s.size(); i++)
+	{
+		char c = s[i];
+		if (c == '"' || c == '\\') fputc('\\', out);
+		if ((unsigned char)c < 32) fprintf(out, "\\u%04x", c);
+		else fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+static void write_json(FILE *out, const std::vector<Result>& results, int repeat)
+{
+	fprintf(out, "{\n  \"threads\": %d,\n  \"repeat\": %d,\n  \"peak_kb\": %lld,\n  \"scenes\": [\n",
+			thread_count(), repeat, peak_kb());
+
+	for (size_t k = 0; k < results.size(); k++)
+	{
+		const Result& r = results[k];
+		double v = r.vertices > 0 ? (double)r.vertices : 1;
+		double d = r.deformed > 0 ? (double)r.deformed : 1;
+
+		fprintf(out, "    {\"name\": ");
+		json_string(out, r.name);
+		fprintf(out, ", \"balloons\": %d, \"segments\": %d, \"pies\": %d, \"vertices\": %lld, \"triangles\": %lld,\n",
+				r.balloons, r.segments, r.pies, r.vertices, r.triangles);
+		fprintf(out, "     \"setup_ms\": %.6f, \"deform_ms\": %.6f, \"export_ms\": %.6f,\n",
+				r.setup_ms, r.deform_ms, r.export_ms);
+		fprintf(out, "     \"setup_ns_per_vertex\": %.3f, \"deform_ns_per_vertex\": %.3f, \"export_ns_per_vertex\": %.3f,\n",
+				1e6*r.setup_ms/v, 1e6*r.deform_ms/d, 1e6*r.export_ms/v);
+		fprintf(out, "     \"setup_mvertices_per_s\": %.3f, \"deform_mvertices_per_s\": %.3f, \"export_mb_per_s\": %.3f,\n",
+				r.setup_ms > 0 ? v/r.setup_ms/1e3 : 0, r.deform_ms > 0 ? d/r.deform_ms/1e3 : 0,
+				r.export_ms > 0 ? r.export_bytes/r.export_ms/1e3 : 0);
+		fprintf(out, "     \"deformed_vertices\": %lld, \"geometry_bytes\": %lld, \"export_bytes\": %lld}%s\n",
+				r.deformed, r.geometry_bytes, r.export_bytes, k + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *samples = "samples";
+	const char *output = 0;
+	int repeat = 3;
+	bool quick = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-samples") == 0 && i + 1 < argc) samples = argv[++i];
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) output = argv[++i];
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) set_thread_count(atoi(argv[++i]));
+		else if (strcmp(argv[i], "-repeat") == 0 && i + 1 < argc) repeat = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-quick") == 0) quick = true;
+		else
+		{
+			usage();
+			return 2;
+		}
+	}
+	if (repeat < 1) repeat = 1;
+
+	std::string export_file = (std::filesystem::temp_directory_path() / "balloon-bench.ply").string();
+	std::vector<Result> results;
+	Scene scene;
+
+	// every .bal under samples, sorted so runs line up
+	std::vector<std::string> files;
+	std::error_code error;
+	for (std::filesystem::recursive_directory_iterator it(samples, error), end; !error && it != end; it.increment(error))
+	{
+		if (it->is_regular_file() && it->path().extension() == ".bal")
+			files.push_back(it->path().generic_string());
+	}
+	std::sort(files.begin(), files.end());
+
+	if (files.empty()) fprintf(stderr, "balloon-bench: no .bal files in %s\n", samples);
+
+	for (size_t k = 0; k < files.size(); k++)
+	{
+		if (!scene.read(files[k].c_str()))
+		{
+			fprintf(stderr, "balloon-bench: %s\n", scene.error());
+			continue;
+		}
+		measure(scene, files[k].c_str(), repeat, export_file, results);
+	}
+
+	// resolution sweep with a hedgehog-like scene
+	static const int resolutions[] = { 16, 30, 60, 120, 240 };
+	int count_resolutions = quick ? 3 : 5;
+	for (int k = 0; k < count_resolutions; k++)
+	{
+		char name[64];
+		sprintf(name, "synthetic/41x%dx%d", resolutions[k], resolutions[k]);
+		synthetic(scene, 41, resolutions[k], resolutions[k]);
+		measure(scene, name, repeat, export_file, results);
+	}
+
+	// balloon count sweep at a low resolution
+	static const int counts[] = { 10, 100, 1000, 10000 };
+	int count_counts = quick ? 3 : 4;
+	for (int k = 0; k < count_counts; k++)
+	{
+		char name[64];
+		sprintf(name, "synthetic/%dx16x16", counts[k]);
+		synthetic(scene, counts[k], 16, 16);
+		measure(scene, name, repeat, export_file, results);
+	}
+
+	FILE *out = output ? fopen(output, "wt") : stdout;
+	if (!out)
+	{
+		fprintf(stderr, "balloon-bench: cannot write %s\n", output);
+		return 1;
+	}
+	write_json(out, results, repeat);
+	if (output) fclose(out);
+
+	return 0;
+}
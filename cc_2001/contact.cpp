@@ -0,0 +1,200 @@
+#include "contact.h"
+#include "threadpool.h"
+#include <math.h>
+#include <algorithm>
+
+
+// how far the mesh of a balloon reaches from its center
+static double reach(const Balloon& b)
+{
+	if (b.setup_complete && b.bound > b.radius) return b.bound;
+	return b.radius;
+}
+
+// can the sphere of b move vertices of a?
+static bool presses(const Balloon& a, const Balloon& b)
+{
+	// check if pressure correct (if == 0 -> do nothing)
+	if (a.pressure + b.pressure == 0) return false;
+
+	double dx = a.x - b.x;
+	double dy = a.y - b.y;
+	double dz = a.z - b.z;
+	double dist = sqrt(dx*dx + dy*dy + dz*dz);
+
+	return dist <= (reach(a) + b.radius)*(1 + REAL_SLACK);
+}
+
+void find_contacts(const Balloon *balloons, int n, std::vector<Contact>& contacts)
+{
+	contacts.clear();
+
+	// extent of every balloon along x, sorted by the start
+	std::vector<int> order(n);
+	std::vector<double> extent(n);
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		order[i] = i;
+		extent[i] = reach(balloons[i]);
+	}
+	std::sort(order.begin(), order.end(), [&](int a, int b)
+	{
+		double sa = balloons[a].x - extent[a], sb = balloons[b].x - extent[b];
+		return sa < sb || (sa == sb && a < b);
+	});
+
+	// sweep - only balloons whose x intervals overlap are tested
+	std::vector<int> active;
+
+	for (int k = 0; k < n; k++)
+	{
+		int a = order[k];
+		const Balloon& A = balloons[a];
+		double start = A.x - extent[a];
+
+		int kept = 0;
+		for (size_t j = 0; j < active.size(); j++)
+		{
+			int b = active[j];
+			const Balloon& B = balloons[b];
+
+			// ends before this one starts - it will not touch any later one either
+			if (B.x + extent[b] < start) continue;
+			active[kept++] = b;
+
+			double e = extent[a] + extent[b];
+			if (fabs(A.y - B.y) > e || fabs(A.z - B.z) > e) continue;
+
+			if (presses(A, B) || presses(B, A))
+			{
+				Contact c;
+				c.a = a < b ? a : b;
+				c.b = a < b ? b : a;
+				contacts.push_back(c);
+			}
+		}
+		active.resize(kept);
+		active.push_back(a);
+	}
+
+	// file order, independent of the sweep
+	std::sort(contacts.begin(), contacts.end(), [](const Contact& p, const Contact& q)
+	{
+		return p.a < q.a || (p.a == q.a && p.b < q.b);
+	});
+}
+
+// the balloons pressing a, in file order
+static void pressing(Balloon *balloons, int a, const std::vector<Contact>& contacts,
+					 std::vector<const Balloon*>& list)
+{
+	list.clear();
+	for (size_t k = 0; k < contacts.size(); k++)
+	{
+		int b = -1;
+		if (contacts[k].a == a) b = contacts[k].b;
+		if (contacts[k].b == a) b = contacts[k].a;
+
+		if (b >= 0 && presses(balloons[a], balloons[b])) list.push_back(balloons + b);
+	}
+	std::sort(list.begin(), list.end());
+}
+
+// balloons sorted by x, to find the ones near a grown balloon
+struct SortedByX
+{
+	std::vector<int> order;
+	std::vector<double> x;
+	double largest;
+};
+
+// deform one balloon against its contacts. negative pressures pull the
+// surface outwards, possibly into balloons which did not touch it before -
+// then start again from the undeformed sphere with them included (on the
+// same lattice, refined or not).
+static void deform_one(Balloon *balloons, int n, int a, const std::vector<Contact>& contacts,
+					   const SortedByX& sorted)
+{
+	Balloon& A = balloons[a];
+	std::vector<const Balloon*> list;
+	pressing(balloons, a, contacts, list);
+
+	while (!list.empty())
+	{
+		double reached = A.bound;
+		A.deform(&list[0], (int)list.size());
+
+		if (A.bound <= reached) break;
+
+		// grown - look for new contacts among the balloons close enough in x
+		double from = A.x - A.bound - sorted.largest;
+		double to = A.x + A.bound + sorted.largest;
+		int k = (int)(std::lower_bound(sorted.x.begin(), sorted.x.end(), from) - sorted.x.begin());
+
+		std::vector<const Balloon*> grown;
+		for (; k < n && sorted.x[k] <= to; k++)
+		{
+			int b = sorted.order[k];
+			if (b != a && presses(A, balloons[b])) grown.push_back(balloons + b);
+		}
+		std::sort(grown.begin(), grown.end());
+
+		if (grown.size() == list.size()) break;
+
+		list.swap(grown);
+		A.reset();
+	}
+}
+
+void deform_all(Balloon *balloons, int n, const unsigned char *only, std::atomic<int> *finished,
+				const std::atomic<bool> *cancel)
+{
+	std::vector<Contact> contacts;
+	find_contacts(balloons, n, contacts);
+
+	SortedByX sorted;
+	sorted.order.resize(n);
+	sorted.x.resize(n);
+	sorted.largest = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+	{
+		sorted.order[i] = i;
+		if (balloons[i].radius > sorted.largest) sorted.largest = balloons[i].radius;
+	}
+	std::sort(sorted.order.begin(), sorted.order.end(), [&](int p, int q)
+	{
+		return balloons[p].x < balloons[q].x;
+	});
+	for (i = 0; i < n; i++)
+		sorted.x[i] = balloons[sorted.order[i]].x;
+
+	ThreadPool& pool = thread_pool();
+
+	// many balloons - one per thread; only a few - one after another,
+	// each deform spreads over the threads itself
+	if (n >= 2*pool.size())
+	{
+		pool.parallel_for(n, 1, [&](int first, int last)
+		{
+			for (int k = first; k < last; k++)
+			{
+				if (cancel && *cancel) return;
+				if (!only || only[k]) deform_one(balloons, n, k, contacts, sorted);
+				if (finished) (*finished)++;
+			}
+		});
+	}
+	else
+	{
+		for (i = 0; i < n; i++)
+		{
+			if (cancel && *cancel) return;
+			if (!only || only[i]) deform_one(balloons, n, i, contacts, sorted);
+			if (finished) (*finished)++;
+		}
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef CONTACT_H
+#define CONTACT_H
+
+#include "balloon.h"
+#include <atomic>
+#include <vector>
+
+struct Contact
+{
+	// indices of the two balloons, a < b
+	int a, b;
+};
+
+// all pairs of balloons where at least one presses into the other,
+// found by sweep and prune along x - not by testing every pair
+void find_contacts(const Balloon *balloons, int n, std::vector<Contact>& contacts);
+
+// press every balloon (not only the first one) against the balloons it
+// touches, in file order. the deformations only read the centers and radii
+// of the others, so the balloons are independent and run in parallel.
+// with only, just the balloons marked there are deformed (they must be
+// set up again before), the others are left as they are. finished (if
+// given) goes up by one for every balloon done; once cancel (if given) is
+// set the balloons not started yet are left undeformed.
+void deform_all(Balloon *balloons, int n, const unsigned char *only = 0, std::atomic<int> *finished = 0,
+				const std::atomic<bool> *cancel = 0);
+
+#endif
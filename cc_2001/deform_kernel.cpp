@@ -0,0 +1,523 @@
+#include "deform_kernel.h"
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DEFORM_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+
+// ***********************************************************
+//							scalar
+// ***********************************************************
+
+// one vertex, same arithmetic as the vector versions below
+static int deform_one(real *x, real *y, real *z, int i, const DeformParams& p,
+					  unsigned char *moved, DeformCounts *counts)
+{
+	real dx = x[i] - p.ox;
+	real dy = y[i] - p.oy;
+	real dz = z[i] - p.oz;
+	real s = dx*dx + dy*dy + dz*dz;
+
+	// without the stats nothing is counted
+	(void)counts;
+	STATS(if (counts) counts->tested++;)
+
+	// vertex outside the 2nd balloon -> stays
+	if (!(sqrt(s) < p.radius)) return 0;
+
+	STATS(if (counts) counts->inside++;)
+
+	real b = p.Vx*dx + p.Vy*dy + p.Vz*dz;
+	real c = s - p.radius*p.radius;
+	real D = b*b - p.a*c;
+
+	if (D < 0)
+	{
+		// error
+		STATS(if (counts) counts->discriminant_failures++;)
+		return 0;
+	}
+
+	real t2 = (-sqrt(D) - b)/p.a;
+	real t1 = (sqrt(D) - b)/p.a;
+	real t;
+
+	if (t2 > 0)
+		t = t2;
+	else if (t1 > 0)
+		t = t1;
+	else
+		t = 0;
+
+	// move point in direction S1->S2 distance  r2/(r1+r2)*width of intersection
+	real Ix = x[i] + t*p.Vx;
+	real Iy = y[i] + t*p.Vy;
+	real Iz = z[i] + t*p.Vz;
+
+	x[i] = x[i] + (Ix - x[i])*p.f;
+	y[i] = y[i] + (Iy - y[i])*p.f;
+	z[i] = z[i] + (Iz - z[i])*p.f;
+
+	moved[i] = 1;
+	return 1;
+}
+
+static int deform_scalar(real *x, real *y, real *z, int begin, int end,
+						 const DeformParams& p, unsigned char *moved, DeformCounts *counts)
+{
+	int count = 0;
+	for (int i = begin; i < end; i++)
+		count += deform_one(x, y, z, i, p, moved, counts);
+	return count;
+}
+
+#if BALLOON_STATS
+// set bits of a lane mask
+static const int lanes[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+#define LANES(m) (lanes[(m) & 15] + lanes[(m) >> 4])
+#endif
+
+
+#if defined(DEFORM_X86) && !BALLOON_FLOAT
+
+// ***********************************************************
+//							SSE2
+// ***********************************************************
+
+TARGET_SSE2
+static int deform_sse2(double *x, double *y, double *z, int begin, int end,
+					   const DeformParams& p, unsigned char *moved, DeformCounts *counts)
+{
+	const __m128d ox = _mm_set1_pd(p.ox);
+	const __m128d oy = _mm_set1_pd(p.oy);
+	const __m128d oz = _mm_set1_pd(p.oz);
+	const __m128d r = _mm_set1_pd(p.radius);
+	const __m128d r2 = _mm_set1_pd(p.radius*p.radius);
+	const __m128d Vx = _mm_set1_pd(p.Vx);
+	const __m128d Vy = _mm_set1_pd(p.Vy);
+	const __m128d Vz = _mm_set1_pd(p.Vz);
+	const __m128d a = _mm_set1_pd(p.a);
+	const __m128d f = _mm_set1_pd(p.f);
+	const __m128d zero = _mm_setzero_pd();
+	const __m128d sign = _mm_set1_pd(-0.0);
+
+	int count = 0;
+	int i = begin;
+
+	for (; i + 2 <= end; i += 2)
+	{
+		__m128d px = _mm_loadu_pd(x + i);
+		__m128d py = _mm_loadu_pd(y + i);
+		__m128d pz = _mm_loadu_pd(z + i);
+
+		__m128d dx = _mm_sub_pd(px, ox);
+		__m128d dy = _mm_sub_pd(py, oy);
+		__m128d dz = _mm_sub_pd(pz, oz);
+		__m128d s = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+
+		__m128d inside = _mm_cmplt_pd(_mm_sqrt_pd(s), r);
+		STATS(if (counts) counts->tested += 2;)
+		if (_mm_movemask_pd(inside) == 0) continue;
+
+		__m128d b = _mm_add_pd(_mm_add_pd(_mm_mul_pd(Vx, dx), _mm_mul_pd(Vy, dy)), _mm_mul_pd(Vz, dz));
+		__m128d c = _mm_sub_pd(s, r2);
+		__m128d D = _mm_sub_pd(_mm_mul_pd(b, b), _mm_mul_pd(a, c));
+
+		// lanes with D < 0 stay where they are
+		__m128d mask = _mm_andnot_pd(_mm_cmplt_pd(D, zero), inside);
+
+		STATS(if (counts)
+		{
+			counts->inside += lanes[_mm_movemask_pd(inside)];
+			counts->discriminant_failures += lanes[_mm_movemask_pd(_mm_and_pd(_mm_cmplt_pd(D, zero), inside))];
+		})
+
+		__m128d sD = _mm_sqrt_pd(D);
+		__m128d t2 = _mm_div_pd(_mm_sub_pd(_mm_xor_pd(sD, sign), b), a);
+		__m128d t1 = _mm_div_pd(_mm_sub_pd(sD, b), a);
+
+		// t = t2 > 0 ? t2 : (t1 > 0 ? t1 : 0)
+		__m128d t = _mm_and_pd(_mm_cmpgt_pd(t1, zero), t1);
+		__m128d use2 = _mm_cmpgt_pd(t2, zero);
+		t = _mm_or_pd(_mm_and_pd(use2, t2), _mm_andnot_pd(use2, t));
+
+		__m128d Ix = _mm_add_pd(px, _mm_mul_pd(t, Vx));
+		__m128d Iy = _mm_add_pd(py, _mm_mul_pd(t, Vy));
+		__m128d Iz = _mm_add_pd(pz, _mm_mul_pd(t, Vz));
+
+		__m128d nx = _mm_add_pd(px, _mm_mul_pd(_mm_sub_pd(Ix, px), f));
+		__m128d ny = _mm_add_pd(py, _mm_mul_pd(_mm_sub_pd(Iy, py), f));
+		__m128d nz = _mm_add_pd(pz, _mm_mul_pd(_mm_sub_pd(Iz, pz), f));
+
+		_mm_storeu_pd(x + i, _mm_or_pd(_mm_and_pd(mask, nx), _mm_andnot_pd(mask, px)));
+		_mm_storeu_pd(y + i, _mm_or_pd(_mm_and_pd(mask, ny), _mm_andnot_pd(mask, py)));
+		_mm_storeu_pd(z + i, _mm_or_pd(_mm_and_pd(mask, nz), _mm_andnot_pd(mask, pz)));
+
+		int m = _mm_movemask_pd(mask);
+		for (int k = 0; k < 2; k++)
+		{
+			if (m & (1 << k))
+			{
+				moved[i + k] = 1;
+				count++;
+			}
+		}
+	}
+
+	return count + deform_scalar(x, y, z, i, end, p, moved, counts);
+}
+
+
+// ***********************************************************
+//							AVX2
+// ***********************************************************
+
+TARGET_AVX2
+static int deform_avx2(double *x, double *y, double *z, int begin, int end,
+					   const DeformParams& p, unsigned char *moved, DeformCounts *counts)
+{
+	const __m256d ox = _mm256_set1_pd(p.ox);
+	const __m256d oy = _mm256_set1_pd(p.oy);
+	const __m256d oz = _mm256_set1_pd(p.oz);
+	const __m256d r = _mm256_set1_pd(p.radius);
+	const __m256d r2 = _mm256_set1_pd(p.radius*p.radius);
+	const __m256d Vx = _mm256_set1_pd(p.Vx);
+	const __m256d Vy = _mm256_set1_pd(p.Vy);
+	const __m256d Vz = _mm256_set1_pd(p.Vz);
+	const __m256d a = _mm256_set1_pd(p.a);
+	const __m256d f = _mm256_set1_pd(p.f);
+	const __m256d zero = _mm256_setzero_pd();
+	const __m256d sign = _mm256_set1_pd(-0.0);
+
+	int count = 0;
+	int i = begin;
+
+	for (; i + 4 <= end; i += 4)
+	{
+		__m256d px = _mm256_loadu_pd(x + i);
+		__m256d py = _mm256_loadu_pd(y + i);
+		__m256d pz = _mm256_loadu_pd(z + i);
+
+		__m256d dx = _mm256_sub_pd(px, ox);
+		__m256d dy = _mm256_sub_pd(py, oy);
+		__m256d dz = _mm256_sub_pd(pz, oz);
+		__m256d s = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+
+		__m256d inside = _mm256_cmp_pd(_mm256_sqrt_pd(s), r, _CMP_LT_OQ);
+		STATS(if (counts) counts->tested += 4;)
+		if (_mm256_movemask_pd(inside) == 0) continue;
+
+		__m256d b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(Vx, dx), _mm256_mul_pd(Vy, dy)), _mm256_mul_pd(Vz, dz));
+		__m256d c = _mm256_sub_pd(s, r2);
+		__m256d D = _mm256_sub_pd(_mm256_mul_pd(b, b), _mm256_mul_pd(a, c));
+
+		// lanes with D < 0 stay where they are
+		__m256d mask = _mm256_andnot_pd(_mm256_cmp_pd(D, zero, _CMP_LT_OQ), inside);
+
+		STATS(if (counts)
+		{
+			counts->inside += lanes[_mm256_movemask_pd(inside)];
+			counts->discriminant_failures += lanes[_mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(D, zero, _CMP_LT_OQ), inside))];
+		})
+
+		__m256d sD = _mm256_sqrt_pd(D);
+		__m256d t2 = _mm256_div_pd(_mm256_sub_pd(_mm256_xor_pd(sD, sign), b), a);
+		__m256d t1 = _mm256_div_pd(_mm256_sub_pd(sD, b), a);
+
+		// t = t2 > 0 ? t2 : (t1 > 0 ? t1 : 0)
+		__m256d t = _mm256_and_pd(_mm256_cmp_pd(t1, zero, _CMP_GT_OQ), t1);
+		t = _mm256_blendv_pd(t, t2, _mm256_cmp_pd(t2, zero, _CMP_GT_OQ));
+
+		__m256d Ix = _mm256_add_pd(px, _mm256_mul_pd(t, Vx));
+		__m256d Iy = _mm256_add_pd(py, _mm256_mul_pd(t, Vy));
+		__m256d Iz = _mm256_add_pd(pz, _mm256_mul_pd(t, Vz));
+
+		__m256d nx = _mm256_add_pd(px, _mm256_mul_pd(_mm256_sub_pd(Ix, px), f));
+		__m256d ny = _mm256_add_pd(py, _mm256_mul_pd(_mm256_sub_pd(Iy, py), f));
+		__m256d nz = _mm256_add_pd(pz, _mm256_mul_pd(_mm256_sub_pd(Iz, pz), f));
+
+		_mm256_storeu_pd(x + i, _mm256_blendv_pd(px, nx, mask));
+		_mm256_storeu_pd(y + i, _mm256_blendv_pd(py, ny, mask));
+		_mm256_storeu_pd(z + i, _mm256_blendv_pd(pz, nz, mask));
+
+		int m = _mm256_movemask_pd(mask);
+		for (int k = 0; k < 4; k++)
+		{
+			if (m & (1 << k))
+			{
+				moved[i + k] = 1;
+				count++;
+			}
+		}
+	}
+
+	return count + deform_scalar(x, y, z, i, end, p, moved, counts);
+}
+
+#endif // DEFORM_X86 && !BALLOON_FLOAT
+
+
+#if defined(DEFORM_X86) && BALLOON_FLOAT
+
+// ***********************************************************
+//							SSE2 (float)
+// ***********************************************************
+
+TARGET_SSE2
+static int deform_sse2(float *x, float *y, float *z, int begin, int end,
+					   const DeformParams& p, unsigned char *moved, DeformCounts *counts)
+{
+	const __m128 ox = _mm_set1_ps(p.ox);
+	const __m128 oy = _mm_set1_ps(p.oy);
+	const __m128 oz = _mm_set1_ps(p.oz);
+	const __m128 r = _mm_set1_ps(p.radius);
+	const __m128 r2 = _mm_set1_ps(p.radius*p.radius);
+	const __m128 Vx = _mm_set1_ps(p.Vx);
+	const __m128 Vy = _mm_set1_ps(p.Vy);
+	const __m128 Vz = _mm_set1_ps(p.Vz);
+	const __m128 a = _mm_set1_ps(p.a);
+	const __m128 f = _mm_set1_ps(p.f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 sign = _mm_set1_ps(-0.0f);
+
+	int count = 0;
+	int i = begin;
+
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 px = _mm_loadu_ps(x + i);
+		__m128 py = _mm_loadu_ps(y + i);
+		__m128 pz = _mm_loadu_ps(z + i);
+
+		__m128 dx = _mm_sub_ps(px, ox);
+		__m128 dy = _mm_sub_ps(py, oy);
+		__m128 dz = _mm_sub_ps(pz, oz);
+		__m128 s = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+		__m128 inside = _mm_cmplt_ps(_mm_sqrt_ps(s), r);
+		STATS(if (counts) counts->tested += 4;)
+		if (_mm_movemask_ps(inside) == 0) continue;
+
+		__m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Vx, dx), _mm_mul_ps(Vy, dy)), _mm_mul_ps(Vz, dz));
+		__m128 c = _mm_sub_ps(s, r2);
+		__m128 D = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, c));
+
+		// lanes with D < 0 stay where they are
+		__m128 mask = _mm_andnot_ps(_mm_cmplt_ps(D, zero), inside);
+
+		STATS(if (counts)
+		{
+			counts->inside += lanes[_mm_movemask_ps(inside)];
+			counts->discriminant_failures += lanes[_mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(D, zero), inside))];
+		})
+
+		__m128 sD = _mm_sqrt_ps(D);
+		__m128 t2 = _mm_div_ps(_mm_sub_ps(_mm_xor_ps(sD, sign), b), a);
+		__m128 t1 = _mm_div_ps(_mm_sub_ps(sD, b), a);
+
+		// t = t2 > 0 ? t2 : (t1 > 0 ? t1 : 0)
+		__m128 t = _mm_and_ps(_mm_cmpgt_ps(t1, zero), t1);
+		__m128 use2 = _mm_cmpgt_ps(t2, zero);
+		t = _mm_or_ps(_mm_and_ps(use2, t2), _mm_andnot_ps(use2, t));
+
+		__m128 Ix = _mm_add_ps(px, _mm_mul_ps(t, Vx));
+		__m128 Iy = _mm_add_ps(py, _mm_mul_ps(t, Vy));
+		__m128 Iz = _mm_add_ps(pz, _mm_mul_ps(t, Vz));
+
+		__m128 nx = _mm_add_ps(px, _mm_mul_ps(_mm_sub_ps(Ix, px), f));
+		__m128 ny = _mm_add_ps(py, _mm_mul_ps(_mm_sub_ps(Iy, py), f));
+		__m128 nz = _mm_add_ps(pz, _mm_mul_ps(_mm_sub_ps(Iz, pz), f));
+
+		_mm_storeu_ps(x + i, _mm_or_ps(_mm_and_ps(mask, nx), _mm_andnot_ps(mask, px)));
+		_mm_storeu_ps(y + i, _mm_or_ps(_mm_and_ps(mask, ny), _mm_andnot_ps(mask, py)));
+		_mm_storeu_ps(z + i, _mm_or_ps(_mm_and_ps(mask, nz), _mm_andnot_ps(mask, pz)));
+
+		int m = _mm_movemask_ps(mask);
+		for (int k = 0; k < 4; k++)
+		{
+			if (m & (1 << k))
+			{
+				moved[i + k] = 1;
+				count++;
+			}
+		}
+	}
+
+	return count + deform_scalar(x, y, z, i, end, p, moved, counts);
+}
+
+
+// ***********************************************************
+//							AVX2 (float)
+// ***********************************************************
+
+TARGET_AVX2
+static int deform_avx2(float *x, float *y, float *z, int begin, int end,
+					   const DeformParams& p, unsigned char *moved, DeformCounts *counts)
+{
+	const __m256 ox = _mm256_set1_ps(p.ox);
+	const __m256 oy = _mm256_set1_ps(p.oy);
+	const __m256 oz = _mm256_set1_ps(p.oz);
+	const __m256 r = _mm256_set1_ps(p.radius);
+	const __m256 r2 = _mm256_set1_ps(p.radius*p.radius);
+	const __m256 Vx = _mm256_set1_ps(p.Vx);
+	const __m256 Vy = _mm256_set1_ps(p.Vy);
+	const __m256 Vz = _mm256_set1_ps(p.Vz);
+	const __m256 a = _mm256_set1_ps(p.a);
+	const __m256 f = _mm256_set1_ps(p.f);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+
+	int count = 0;
+	int i = begin;
+
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 px = _mm256_loadu_ps(x + i);
+		__m256 py = _mm256_loadu_ps(y + i);
+		__m256 pz = _mm256_loadu_ps(z + i);
+
+		__m256 dx = _mm256_sub_ps(px, ox);
+		__m256 dy = _mm256_sub_ps(py, oy);
+		__m256 dz = _mm256_sub_ps(pz, oz);
+		__m256 s = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+		__m256 inside = _mm256_cmp_ps(_mm256_sqrt_ps(s), r, _CMP_LT_OQ);
+		STATS(if (counts) counts->tested += 8;)
+		if (_mm256_movemask_ps(inside) == 0) continue;
+
+		__m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Vx, dx), _mm256_mul_ps(Vy, dy)), _mm256_mul_ps(Vz, dz));
+		__m256 c = _mm256_sub_ps(s, r2);
+		__m256 D = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, c));
+
+		// lanes with D < 0 stay where they are
+		__m256 mask = _mm256_andnot_ps(_mm256_cmp_ps(D, zero, _CMP_LT_OQ), inside);
+
+		STATS(if (counts)
+		{
+			counts->inside += LANES(_mm256_movemask_ps(inside));
+			counts->discriminant_failures += LANES(_mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(D, zero, _CMP_LT_OQ), inside)));
+		})
+
+		__m256 sD = _mm256_sqrt_ps(D);
+		__m256 t2 = _mm256_div_ps(_mm256_sub_ps(_mm256_xor_ps(sD, sign), b), a);
+		__m256 t1 = _mm256_div_ps(_mm256_sub_ps(sD, b), a);
+
+		// t = t2 > 0 ? t2 : (t1 > 0 ? t1 : 0)
+		__m256 t = _mm256_and_ps(_mm256_cmp_ps(t1, zero, _CMP_GT_OQ), t1);
+		t = _mm256_blendv_ps(t, t2, _mm256_cmp_ps(t2, zero, _CMP_GT_OQ));
+
+		__m256 Ix = _mm256_add_ps(px, _mm256_mul_ps(t, Vx));
+		__m256 Iy = _mm256_add_ps(py, _mm256_mul_ps(t, Vy));
+		__m256 Iz = _mm256_add_ps(pz, _mm256_mul_ps(t, Vz));
+
+		__m256 nx = _mm256_add_ps(px, _mm256_mul_ps(_mm256_sub_ps(Ix, px), f));
+		__m256 ny = _mm256_add_ps(py, _mm256_mul_ps(_mm256_sub_ps(Iy, py), f));
+		__m256 nz = _mm256_add_ps(pz, _mm256_mul_ps(_mm256_sub_ps(Iz, pz), f));
+
+		_mm256_storeu_ps(x + i, _mm256_blendv_ps(px, nx, mask));
+		_mm256_storeu_ps(y + i, _mm256_blendv_ps(py, ny, mask));
+		_mm256_storeu_ps(z + i, _mm256_blendv_ps(pz, nz, mask));
+
+		int m = _mm256_movemask_ps(mask);
+		for (int k = 0; k < 8; k++)
+		{
+			if (m & (1 << k))
+			{
+				moved[i + k] = 1;
+				count++;
+			}
+		}
+	}
+
+	return count + deform_scalar(x, y, z, i, end, p, moved, counts);
+}
+
+#endif // DEFORM_X86 && BALLOON_FLOAT
+
+#ifdef DEFORM_X86
+
+static bool has_avx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+
+	// the OS has to save the ymm registers too
+	__cpuid(info, 1);
+	if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) return false;
+	if ((_xgetbv(0) & 6) != 6) return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif // DEFORM_X86
+
+
+// ***********************************************************
+//							dispatch
+// ***********************************************************
+
+typedef int (*DeformFunc)(real *, real *, real *, int, int, const DeformParams&,
+						  unsigned char *, DeformCounts *);
+
+static DeformFunc choose_kernel(const char **name)
+{
+#ifdef DEFORM_X86
+	if (has_avx2())
+	{
+		*name = "avx2";
+		return deform_avx2;
+	}
+#if defined(_M_X64) || defined(__x86_64__)
+	// every x86-64 processor has SSE2
+	*name = "sse2";
+	return deform_sse2;
+#else
+	*name = "scalar";
+	return deform_scalar;
+#endif
+#else
+	*name = "scalar";
+	return deform_scalar;
+#endif
+}
+
+static const char *kernel_name = 0;
+static DeformFunc kernel = choose_kernel(&kernel_name);
+
+int deform_vertices(real *x, real *y, real *z, int begin, int end,
+					const DeformParams& p, unsigned char *moved, DeformCounts *counts)
+{
+	return kernel(x, y, z, begin, end, p, moved, counts);
+}
+
+int deform_vertex(real *x, real *y, real *z, int i,
+				  const DeformParams& p, unsigned char *moved, DeformCounts *counts)
+{
+	return deform_one(x, y, z, i, p, moved, counts);
+}
+
+const char *deform_kernel_name()
+{
+	return kernel_name;
+}
@@ -0,0 +1,41 @@
+#ifndef DEFORM_KERNEL_H
+#define DEFORM_KERNEL_H
+
+#include "stats.h"
+#include "real.h"
+
+// everything the kernel needs to know about one deformation,
+// computed once per Balloon::deform call - in the precision of the
+// vertices, the kernel does all its arithmetic in it
+struct DeformParams
+{
+	// center and radius of the other balloon
+	real ox, oy, oz;
+	real radius;
+
+	// vector between the centers of the balloons and its squared length
+	real Vx, Vy, Vz;
+	real a;
+
+	// how far towards the intersection the point moves
+	// Other.pressure / (pressure + Other.pressure)
+	real f;
+};
+
+// move all vertices in [begin, end) which lie inside the other balloon,
+// sets moved[i] = 1 for each of them and returns their number.
+// picks the widest instruction set the processor supports (AVX2, SSE2 or
+// plain C++), all of them give bit-identical results. 4 (AVX2) or 2 (SSE2)
+// vertices at once, twice as many in a BALLOON_FLOAT build.
+// counts (may be 0) gets what was tested, unless BALLOON_STATS is 0.
+int deform_vertices(real *x, real *y, real *z, int begin, int end,
+					const DeformParams& p, unsigned char *moved, DeformCounts *counts = 0);
+
+// the same for the single vertex i, returns 1 if it moved
+int deform_vertex(real *x, real *y, real *z, int i,
+				  const DeformParams& p, unsigned char *moved, DeformCounts *counts = 0);
+
+// name of the kernel deform_vertices uses ("avx2", "sse2" or "scalar")
+const char *deform_kernel_name();
+
+#endif
@@ -0,0 +1,478 @@
+#include "deformation.h"
+#include "deform_kernel.h"
+#include "grid.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+
+// ***********************************************************
+//							Deformation
+// ***********************************************************
+Deformation::Deformation(Balloon& object) : object(object)
+{
+	int n = object.count_vertices;
+
+	base_x.assign(object.vertices.x, object.vertices.x + n);
+	base_y.assign(object.vertices.y, object.vertices.y + n);
+	base_z.assign(object.vertices.z, object.vertices.z + n);
+
+	base_rows.assign(object.row_bounds, object.row_bounds + object.rows);
+	base_cols.assign(object.col_bounds, object.col_bounds + object.cols);
+	base_bound = object.bound;
+
+	moves.assign(n, 0);
+	travel.assign(n, 0);
+	marked.assign(n, 0);
+}
+
+void Deformation::add(const Balloon& other)
+{
+	Deformer d;
+	d.x = other.x; d.y = other.y; d.z = other.z;
+	d.radius = other.radius;
+	d.pressure = other.pressure;
+
+	reachable(d);
+	deformers.push_back(d);
+
+	recompute();
+}
+
+void Deformation::add(const Balloon *others, int n)
+{
+	for (int k = 0; k < n; k++)
+	{
+		Deformer d;
+		d.x = others[k].x; d.y = others[k].y; d.z = others[k].z;
+		d.radius = others[k].radius;
+		d.pressure = others[k].pressure;
+
+		reachable(d);
+		deformers.push_back(d);
+	}
+
+	recompute();
+}
+
+void Deformation::change(int k, const Balloon& other)
+{
+	const Balloon *p = &other;
+	update(&k, &p, 1, object.pressure);
+}
+
+void Deformation::remove(int k)
+{
+	touched(k);
+	deformers.erase(deformers.begin() + k);
+
+	recompute();
+}
+
+void Deformation::set_pressure(double pressure)
+{
+	update(0, 0, 0, pressure);
+}
+
+void Deformation::update(const int *which, const Balloon *const *others, int n, double pressure)
+{
+	// every deformer pushes with another strength
+	bool all = pressure != object.pressure;
+	int i, k;
+
+	// where they were
+	if (all)
+	{
+		for (k = 0; k < count(); k++)
+			touched(k);
+	}
+	else
+	{
+		for (i = 0; i < n; i++)
+			touched(which[i]);
+	}
+
+	object.pressure = pressure;
+	for (i = 0; i < n; i++)
+	{
+		Deformer& d = deformers[which[i]];
+		const Balloon& other = *others[i];
+		d.x = other.x; d.y = other.y; d.z = other.z;
+		d.radius = other.radius;
+		d.pressure = other.pressure;
+	}
+
+	// and where they can reach now - the vertices neither of them
+	// reaches stay at the base
+	if (all)
+	{
+		for (k = 0; k < count(); k++)
+			reachable(deformers[k], false);
+	}
+	else
+	{
+		for (i = 0; i < n; i++)
+			reachable(deformers[which[i]]);
+	}
+
+	recompute();
+}
+
+void Deformation::reachable(const Deformer& d, bool moved)
+{
+	// check if pressure correct (if == 0 -> do nothing)
+	if (object.pressure + d.pressure == 0) return;
+
+	double r = d.radius*(1 + REAL_SLACK);
+	int rows = object.rows, cols = object.cols;
+	int i, j;
+
+	// vertices nobody moved are still at the base - only the bands
+	// of the undeformed sphere touching the deformer need a look
+	std::vector<int> cols_near;
+	for (j = 0; j < cols; j++)
+		if (bounds_touch(base_cols[j], d.x, d.y, d.z, r)) cols_near.push_back(j);
+
+	for (i = 0; i < rows; i++)
+	{
+		if (!bounds_touch(base_rows[i], d.x, d.y, d.z, r)) continue;
+
+		for (size_t n = 0; n < cols_near.size(); n++)
+		{
+			int v = i*cols + cols_near[n];
+			if (marked[v] || moves[v]) continue;
+
+			double dx = base_x[v] - d.x, dy = base_y[v] - d.y, dz = base_z[v] - d.z;
+			if (dx*dx + dy*dy + dz*dz > r*r) continue;
+
+			marked[v] = 1;
+			candidates.push_back(v);
+		}
+	}
+
+	// moved vertices are somewhere within their travel around the base
+	for (size_t k = 0; moved && k < deformers.size(); k++)
+	{
+		const std::vector<Displacement>& list = deformers[k].moved;
+
+		for (size_t n = 0; n < list.size(); n++)
+		{
+			int v = list[n].vertex;
+			if (marked[v]) continue;
+
+			double dx = base_x[v] - d.x, dy = base_y[v] - d.y, dz = base_z[v] - d.z;
+			if (sqrt(dx*dx + dy*dy + dz*dz) > r + travel[v]) continue;
+
+			marked[v] = 1;
+			candidates.push_back(v);
+		}
+	}
+}
+
+void Deformation::touched(int k)
+{
+	const std::vector<Displacement>& list = deformers[k].moved;
+
+	for (size_t n = 0; n < list.size(); n++)
+	{
+		int v = list[n].vertex;
+		if (marked[v]) continue;
+
+		marked[v] = 1;
+		candidates.push_back(v);
+	}
+}
+
+void Deformation::recompute()
+{
+	if (candidates.empty()) return;
+
+	Balloon& B = object;
+	int n = (int)deformers.size();
+	int i, k;
+
+	// forget what the deformers did to the candidates
+	for (k = 0; k < n; k++)
+	{
+		std::vector<Displacement>& list = deformers[k].moved;
+		list.erase(std::remove_if(list.begin(), list.end(), [&](const Displacement& d)
+		{
+			return marked[d.vertex] != 0;
+		}), list.end());
+	}
+
+	for (size_t c = 0; c < candidates.size(); c++)
+	{
+		int v = candidates[c];
+		B.vertices.x[v] = base_x[v];
+		B.vertices.y[v] = base_y[v];
+		B.vertices.z[v] = base_z[v];
+		moves[v] = 0;
+		travel[v] = 0;
+	}
+
+	// the same parameters and grid as Balloon::deform with all of them
+	std::vector<DeformParams> params(n);
+	std::vector<Sphere> spheres(n);
+	std::vector<int> index(n);
+	int used = 0;
+
+	for (k = 0; k < n; k++)
+	{
+		const Deformer& d = deformers[k];
+		if (B.pressure + d.pressure == 0) continue;
+
+		double Vx = B.x - d.x;
+		double Vy = B.y - d.y;
+		double Vz = B.z - d.z;
+
+		DeformParams& p = params[used];
+		p.ox = d.x; p.oy = d.y; p.oz = d.z;
+		p.radius = d.radius;
+		p.Vx = Vx; p.Vy = Vy; p.Vz = Vz;
+		p.a = Vx*Vx + Vy*Vy + Vz*Vz;
+		p.f = d.pressure/(B.pressure+d.pressure);
+
+		spheres[used].x = d.x;
+		spheres[used].y = d.y;
+		spheres[used].z = d.z;
+		spheres[used].radius = d.radius*(1 + REAL_SLACK);
+
+		index[used] = k;
+		used++;
+	}
+
+	// the row boxes only grow, so they hold the base and every deformed vertex
+	Bounds box = B.row_bounds[0];
+	for (i = 1; i < B.rows; i++)
+	{
+		const Bounds& r = B.row_bounds[i];
+		bounds_extend(box, r.min_x, r.min_y, r.min_z);
+		bounds_extend(box, r.max_x, r.max_y, r.max_z);
+	}
+
+	SphereGrid grid;
+	grid.build(used ? &spheres[0] : 0, used, box);
+
+	int first_row = B.rows, last_row = -1;
+	int first_col = B.cols, last_col = -1;
+	unsigned char scratch = 0;
+
+	for (size_t c = 0; c < candidates.size(); c++)
+	{
+		int v = candidates[c];
+		real *X = B.vertices.x, *Y = B.vertices.y, *Z = B.vertices.z;
+
+		int after = -1;
+		int cell = grid.cell(X[v], Y[v], Z[v]);
+
+		while (cell >= 0)
+		{
+			int count_items;
+			const int *items = grid.items(cell, count_items);
+			int next_cell = -1;
+
+			for (int j = 0; j < count_items; j++)
+			{
+				k = items[j];
+				if (k <= after) continue;
+
+				after = k;
+
+				const Sphere& S = spheres[k];
+				double dx = X[v] - S.x;
+				double dy = Y[v] - S.y;
+				double dz = Z[v] - S.z;
+				if (dx*dx + dy*dy + dz*dz > S.radius*S.radius) continue;
+
+				double px = X[v], py = Y[v], pz = Z[v];
+
+				// arrays shifted to v, so the kernel's flag goes to scratch
+				if (deform_vertex(X + v, Y + v, Z + v, 0, params[k], &scratch))
+				{
+					Displacement D;
+					D.vertex = v;
+					D.dx = X[v] - px; D.dy = Y[v] - py; D.dz = Z[v] - pz;
+					deformers[index[k]].moved.push_back(D);
+
+					moves[v]++;
+					travel[v] += sqrt(D.dx*D.dx + D.dy*D.dy + D.dz*D.dz);
+
+					next_cell = grid.cell(X[v], Y[v], Z[v]);
+					break;
+				}
+			}
+			cell = next_cell;
+		}
+
+		// let the balloon grow its bounds and renormalize around the candidates
+		B.moved[v] = 1;
+
+		int row = v / B.cols, col = v % B.cols;
+		if (row < first_row) first_row = row;
+		if (row > last_row) last_row = row;
+		if (col < first_col) first_col = col;
+		if (col > last_col) last_col = col;
+	}
+
+	B.finish_deform(first_row, last_row, first_col, last_col);
+
+	// finish_deform only grows the boxes and the bound - a fresh deform
+	// has the base grown by the vertices moved now, wherever they were
+	// before. again for the rows and columns of the candidates.
+	std::vector<unsigned char> rows_hit(B.rows, 0), cols_hit(B.cols, 0);
+	for (size_t c = 0; c < candidates.size(); c++)
+	{
+		rows_hit[candidates[c] / B.cols] = 1;
+		cols_hit[candidates[c] % B.cols] = 1;
+	}
+
+	int j, v;
+	for (i = 0; i < B.rows; i++)
+	{
+		if (!rows_hit[i]) continue;
+
+		B.row_bounds[i] = base_rows[i];
+		for (v = i*B.cols; v < (i + 1)*B.cols; v++)
+			if (moves[v]) bounds_extend(B.row_bounds[i], B.vertices.x[v], B.vertices.y[v], B.vertices.z[v]);
+	}
+	for (j = 0; j < B.cols; j++)
+	{
+		if (!cols_hit[j]) continue;
+
+		B.col_bounds[j] = base_cols[j];
+		for (v = j; v < B.count_vertices; v += B.cols)
+			if (moves[v]) bounds_extend(B.col_bounds[j], B.vertices.x[v], B.vertices.y[v], B.vertices.z[v]);
+	}
+
+	B.bound = base_bound;
+	for (v = 0; v < B.count_vertices; v++)
+	{
+		if (!moves[v]) continue;
+
+		double vx = B.vertices.x[v], vy = B.vertices.y[v], vz = B.vertices.z[v];
+		double d = sqrt((vx-B.x)*(vx-B.x) + (vy-B.y)*(vy-B.y) + (vz-B.z)*(vz-B.z));
+		if (d > B.bound) B.bound = d;
+	}
+
+	// quads whose corners are all back at the base are smooth again, with
+	// the zero face normal of setup
+	for (size_t c = 0; c < candidates.size(); c++)
+	{
+		int v = candidates[c];
+		int row = v / B.cols, col = v % B.cols;
+
+		for (int qi = row; qi <= row + 1; qi++)
+		{
+			for (int qj = col - 1; qj <= col; qj++)
+			{
+				if (qi < 1 || qi > B.rows - 1 || qj < 0 || qj > B.cols - 2) continue;
+
+				int q = qi*B.cols + qj;
+				if (moves[q] || moves[q + 1] || moves[q - B.cols] || moves[q - B.cols + 1]) continue;
+
+				int t = 2*((qi-1)*(B.cols-1) + qj);
+				for (int h = t; h <= t + 1; h++)
+				{
+					B.mesh[h].flat = false;
+					B.mesh[h].nx = B.mesh[h].ny = B.mesh[h].nz = 0;
+				}
+			}
+		}
+	}
+
+	for (size_t c = 0; c < candidates.size(); c++)
+		marked[candidates[c]] = 0;
+	candidates.clear();
+}
+
+
+// ***********************************************************
+//							press_object
+// ***********************************************************
+static bool same_pose(const Balloon& b, const Pose& p)
+{
+	return b.x == p.x && b.y == p.y && b.z == p.z && b.radius == p.radius && b.pressure == p.pressure;
+}
+
+static void set_pose(Balloon& b, const Pose& p)
+{
+	b.x = p.x; b.y = p.y; b.z = p.z;
+	b.radius = p.radius; b.pressure = p.pressure;
+}
+
+int press_object(Balloon *balloons, const Pose *poses, int n, Deformation *&deformation,
+				 int segments, int pies, bool object_color, bool around_color, Arena *arena)
+{
+	Balloon& object = balloons[0];
+	const Pose& o = poses[0];
+	bool fresh = !deformation;
+	int set_up = 0;
+	int k;
+
+	// the others are not deformed - a new pose is a new sphere
+	std::vector<int> changed;
+	for (k = 1; k < n; k++)
+	{
+		if (!fresh && same_pose(balloons[k], poses[k])) continue;
+
+		set_pose(balloons[k], poses[k]);
+		balloons[k].setup(segments, pies, around_color, arena);
+		changed.push_back(k);
+		set_up++;
+	}
+
+	// moved or grown - other vertices, start over
+	if (fresh || object.x != o.x || object.y != o.y || object.z != o.z || object.radius != o.radius)
+	{
+		set_pose(object, o);
+		object.setup(segments, pies, object_color, arena);
+
+		delete deformation;
+		deformation = new Deformation(object);
+		deformation->add(balloons + 1, n - 1);
+		return set_up + 1;
+	}
+
+	// the deformers are the others shifted by one
+	std::vector<int> which(changed.size());
+	std::vector<const Balloon *> others(changed.size());
+	for (size_t c = 0; c < changed.size(); c++)
+	{
+		which[c] = changed[c] - 1;
+		others[c] = balloons + changed[c];
+	}
+	deformation->update(which.empty() ? 0 : &which[0], others.empty() ? 0 : &others[0],
+						(int)changed.size(), o.pressure);
+
+	return set_up;
+}
+
+bool deformation_matches(const Balloon *balloons, int n, int segments, int pies, bool color)
+{
+	const Balloon& B = balloons[0];
+
+	Balloon fresh;
+	fresh.x = B.x; fresh.y = B.y; fresh.z = B.z;
+	fresh.radius = B.radius; fresh.pressure = B.pressure;
+	fresh.setup(segments, pies, color);
+	if (n > 1) fresh.deform(balloons + 1, n - 1);
+
+	if (fresh.count_vertices != B.count_vertices || fresh.count != B.count) return false;
+
+	// the six arrays are one block
+	if (memcmp(fresh.vertices.x, B.vertices.x, 6*B.count_vertices*sizeof(real)) != 0) return false;
+	if (memcmp(fresh.row_bounds, B.row_bounds, B.rows*sizeof(Bounds)) != 0) return false;
+	if (memcmp(fresh.col_bounds, B.col_bounds, B.cols*sizeof(Bounds)) != 0) return false;
+	if (fresh.bound != B.bound) return false;
+
+	// bit for bit - the degenerate triangles at the poles have NaN normals
+	for (int t = 0; t < B.count; t++)
+	{
+		const Triangle& P = fresh.mesh[t];
+		const Triangle& Q = B.mesh[t];
+		if (P.a != Q.a || P.b != Q.b || P.c != Q.c || P.flat != Q.flat) return false;
+		if (memcmp(&P.nx, &Q.nx, 7*sizeof(real)) != 0) return false;
+	}
+	return true;
+}
@@ -0,0 +1,114 @@
+#ifndef DEFORMATION_H
+#define DEFORMATION_H
+
+#include "balloon.h"
+#include <vector>
+
+// how far one deformer moved one vertex
+struct Displacement
+{
+	int vertex;
+	double dx, dy, dz;
+};
+
+// the object balloon together with the balloons pressing it.
+// keeps the undeformed vertices and what every deformer did to them, so
+// changing, adding or removing one deformer only recomputes the vertices
+// it can reach instead of setting up and deforming everything again.
+// the result (vertices, normals, flat triangles, boxes and bound) is the
+// same as object.setup(...) followed by object.deform(deformers, count()).
+class Deformation
+{
+public:
+	// object must be set up and not deformed yet
+	Deformation(Balloon& object);
+
+	// number of deformers
+	int count() const { return (int)deformers.size(); }
+
+	// what deformer k did
+	const std::vector<Displacement>& displacements(int k) const { return deformers[k].moved; }
+
+	// new deformer after all the others
+	void add(const Balloon& other);
+
+	// n of them, in one pass over the vertices
+	void add(const Balloon *others, int n);
+
+	// deformer k moved, or got another radius or pressure
+	void change(int k, const Balloon& other);
+
+	// deformer k gone
+	void remove(int k);
+
+	// the pressure of the object itself changed - every deformer is affected
+	void set_pressure(double pressure);
+
+	// change(which[i], *others[i]) for i = 0 .. n-1 and set_pressure, in
+	// one pass over the vertices
+	void update(const int *which, const Balloon *const *others, int n, double pressure);
+
+private:
+	struct Deformer
+	{
+		// the parts of the other balloon which matter
+		double x, y, z;
+		double radius;
+		double pressure;
+
+		std::vector<Displacement> moved;
+	};
+
+	// vertices the deformer can reach, at any step of the deformation.
+	// without moved the moved vertices are left out - they are marked
+	// already.
+	void reachable(const Deformer& d, bool moved = true);
+
+	// vertices the deformer moved
+	void touched(int k);
+
+	// deform the collected vertices again, starting from the base
+	void recompute();
+
+	Balloon& object;
+
+	// undeformed vertices, the boxes around their rows and columns and
+	// the bound of the undeformed object
+	std::vector<double> base_x, base_y, base_z;
+	std::vector<Bounds> base_rows, base_cols;
+	double base_bound;
+
+	std::vector<Deformer> deformers;
+
+	// per vertex: how many deformers moved it and how far in total
+	std::vector<int> moves;
+	std::vector<double> travel;
+
+	// vertices to recompute
+	std::vector<unsigned char> marked;
+	std::vector<int> candidates;
+};
+
+// place, size and pressure of a balloon - all pressing depends on
+struct Pose
+{
+	double x, y, z;
+	double radius;
+	double pressure;
+};
+
+// bring balloons[0 .. n-1] to the poses, with the object (balloons[0])
+// pressed by all the others like balloons[0].deform(balloons + 1, n - 1).
+// deformation is the object's from the last call (0 the first time - then
+// all the balloons are set up): only the balloons whose pose changed are
+// set up again, the object only when it moved or changed its radius.
+// returns the number of balloons set up.
+int press_object(Balloon *balloons, const Pose *poses, int n, Deformation *&deformation,
+				 int segments, int pies, bool object_color, bool around_color, Arena *arena);
+
+// true if balloons[0] is exactly (vertices, normals, boxes, bound and
+// triangles) what a fresh setup and deform(balloons + 1, n - 1) gives -
+// to check press_object and Deformation against
+bool deformation_matches(const Balloon *balloons, int n, int segments, int pies, bool color);
+
+#endif
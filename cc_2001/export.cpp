@@ -0,0 +1,469 @@
+#include "export.h"
+#include "stats.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// big writes instead of many small ones
+#define WRITE_BUFFER (1 << 20)
+
+
+// ***********************************************************
+//							Writer
+// ***********************************************************
+static bool little_endian()
+{
+	unsigned int one = 1;
+	return *(unsigned char *)&one == 1;
+}
+
+// binary output collected in a big buffer, numbers stored little endian
+class Writer
+{
+public:
+	Writer(FILE *stream) : stream(stream), fill(0), written(0), failed(false)
+	{
+		buffer = new unsigned char[WRITE_BUFFER];
+		swap = !little_endian();
+	}
+	~Writer() { delete[] buffer; }
+
+	void bytes(const void *data, size_t size)
+	{
+		const unsigned char *p = (const unsigned char *)data;
+		while (size > 0)
+		{
+			// big blocks go straight to the file
+			if (fill == 0 && size >= WRITE_BUFFER)
+			{
+				if (fwrite(p, 1, size, stream) != size) failed = true;
+				written += size;
+				return;
+			}
+
+			size_t part = WRITE_BUFFER - fill < size ? WRITE_BUFFER - fill : size;
+			memcpy(buffer + fill, p, part);
+			fill += part;
+			written += part;
+			p += part;
+			size -= part;
+
+			if (fill == WRITE_BUFFER) flush();
+		}
+	}
+
+	// a number in little endian order
+	void number(const void *data, size_t size)
+	{
+		if (!swap)
+		{
+			bytes(data, size);
+			return;
+		}
+		unsigned char b[8];
+		for (size_t i = 0; i < size; i++) b[i] = ((const unsigned char *)data)[size - 1 - i];
+		bytes(b, size);
+	}
+
+	void u8(unsigned char v) { bytes(&v, 1); }
+	void u16(unsigned short v) { number(&v, 2); }
+	void u32(unsigned int v) { number(&v, 4); }
+	void u64(unsigned long long v) { number(&v, 8); }
+	void f32(float v) { number(&v, 4); }
+	void f64(double v) { number(&v, 8); }
+
+	// an array as doubles, copied as it is on little endian machines
+	// (unless the meshes are float)
+	void doubles(const real *v, size_t n)
+	{
+		if (!swap && sizeof(real) == sizeof(double)) bytes(v, n*sizeof(real));
+		else for (size_t i = 0; i < n; i++) f64(v[i]);
+	}
+
+	// zeros up to the next multiple of align
+	void pad(size_t align)
+	{
+		static const unsigned char zeros[64] = { 0 };
+		while (written % align) bytes(zeros, align - written % align < 64 ? align - written % align : 64);
+	}
+
+	void flush()
+	{
+		if (fill && fwrite(buffer, 1, fill, stream) != fill) failed = true;
+		fill = 0;
+	}
+
+	size_t offset() const { return written; }
+	bool ok() const { return !failed; }
+
+private:
+	FILE *stream;
+	unsigned char *buffer;
+	size_t fill;
+	size_t written;
+	bool failed;
+	bool swap;
+};
+
+// open for binary writing, the buffer is ours
+static FILE *open_binary(const char *filename)
+{
+	FILE *stream = fopen(filename, "wb");
+	if (stream) setvbuf(stream, 0, _IONBF, 0);
+	return stream;
+}
+
+static bool close_binary(FILE *stream, Writer& out)
+{
+	out.flush();
+	bool ok = out.ok() && !ferror(stream);
+	if (fclose(stream) != 0) ok = false;
+	return ok;
+}
+
+// colour channel as a byte
+static unsigned char channel(double c)
+{
+	if (c <= 0) return 0;
+	if (c >= 1) return 255;
+	return (unsigned char)(c*255 + .5);
+}
+
+// normal of a triangle from its corners, 0 if it has no area
+static void face_normal(const Balloon& b, const Triangle& T, double& nx, double& ny, double& nz)
+{
+	const Vertices& V = b.vertices;
+
+	double ux = V.x[T.b] - V.x[T.a], uy = V.y[T.b] - V.y[T.a], uz = V.z[T.b] - V.z[T.a];
+	double vx = V.x[T.c] - V.x[T.a], vy = V.y[T.c] - V.y[T.a], vz = V.z[T.c] - V.z[T.a];
+
+	nx = uy*vz - uz*vy;
+	ny = uz*vx - ux*vz;
+	nz = ux*vy - uy*vx;
+	double dn = sqrt(nx*nx + ny*ny + nz*nz);
+
+	if (dn > 0)
+	{
+		nx /= dn; ny /= dn; nz /= dn;
+	}
+	else nx = ny = nz = 0;
+}
+
+// normal of the sphere at a vertex, from the centre out. the stored nx, ny,
+// nz are the position over the radius, a normal only for a balloon at the
+// origin, so they are not exported.
+static void vertex_normal(const Balloon& b, int i, double& nx, double& ny, double& nz)
+{
+	const Vertices& V = b.vertices;
+
+	nx = V.x[i] - b.x;
+	ny = V.y[i] - b.y;
+	nz = V.z[i] - b.z;
+	double dn = sqrt(nx*nx + ny*ny + nz*nz);
+
+	if (dn > 0)
+	{
+		nx /= dn; ny /= dn; nz /= dn;
+	}
+	else nx = ny = nz = 0;
+}
+
+
+// ***********************************************************
+//							.obj
+// ***********************************************************
+bool write_obj(const char *filename, const Balloon *balloons, int n)
+{
+	STATS(PhaseTimer timer(PHASE_EXPORT);)
+
+	FILE *stream = fopen(filename, "wt");
+	if (!stream) return false;
+
+	setvbuf(stream, 0, _IOFBF, WRITE_BUFFER);
+
+	// obj indices count from 1 over the whole file
+	int first_vertex = 1, first_normal = 1;
+
+	for (int k = 0; k < n; k++)
+	{
+		const Balloon& b = balloons[k];
+		if (!b.setup_complete) continue;
+
+		const Vertices& V = b.vertices;
+		int i;
+
+		fprintf(stream, "o balloon%d\n", k);
+
+		for (i = 0; i < b.count_vertices; i++)
+			fprintf(stream, "v %.9g %.9g %.9g\n", V.x[i], V.y[i], V.z[i]);
+
+		// vertex normals first, then one for every flat triangle
+		for (i = 0; i < b.count_vertices; i++)
+		{
+			double nx, ny, nz;
+			vertex_normal(b, i, nx, ny, nz);
+			fprintf(stream, "vn %.9g %.9g %.9g\n", nx, ny, nz);
+		}
+
+		int flat = 0;
+		for (i = 0; i < b.count; i++)
+		{
+			const Triangle& T = b.mesh[i];
+			if (T.flat)
+			{
+				fprintf(stream, "vn %.9g %.9g %.9g\n", T.nx, T.ny, T.nz);
+				flat++;
+			}
+		}
+
+		int face_normal = first_normal + b.count_vertices;
+		for (i = 0; i < b.count; i++)
+		{
+			const Triangle& T = b.mesh[i];
+			int va = first_vertex + T.a, vb = first_vertex + T.b, vc = first_vertex + T.c;
+
+			if (T.flat)
+			{
+				fprintf(stream, "f %d//%d %d//%d %d//%d\n", va, face_normal, vb, face_normal, vc, face_normal);
+				face_normal++;
+			}
+			else
+			{
+				fprintf(stream, "f %d//%d %d//%d %d//%d\n",
+						va, first_normal + T.a, vb, first_normal + T.b, vc, first_normal + T.c);
+			}
+		}
+
+		first_vertex += b.count_vertices;
+		first_normal += b.count_vertices + flat;
+	}
+
+	bool ok = !ferror(stream);
+	if (fclose(stream) != 0) ok = false;
+	return ok;
+}
+
+
+// ***********************************************************
+//							.ply
+// ***********************************************************
+bool write_ply(const char *filename, const Balloon *balloons, int n)
+{
+	STATS(PhaseTimer timer(PHASE_EXPORT);)
+
+	FILE *stream = open_binary(filename);
+	if (!stream) return false;
+
+	Writer out(stream);
+	long long vertices = 0, triangles = 0;
+	int k;
+
+	for (k = 0; k < n; k++)
+	{
+		if (!balloons[k].setup_complete) continue;
+		vertices += balloons[k].count_vertices;
+		triangles += balloons[k].count;
+	}
+
+	char header[512];
+	int length = sprintf(header,
+		"ply\n"
+		"format binary_little_endian 1.0\n"
+		"element vertex %lld\n"
+		"property float x\nproperty float y\nproperty float z\n"
+		"property float nx\nproperty float ny\nproperty float nz\n"
+		"element face %lld\n"
+		"property list uchar int vertex_indices\n"
+		"property float nx\nproperty float ny\nproperty float nz\n"
+		"property uchar red\nproperty uchar green\nproperty uchar blue\nproperty uchar alpha\n"
+		"end_header\n", vertices, triangles);
+	out.bytes(header, length);
+
+	for (k = 0; k < n; k++)
+	{
+		const Balloon& b = balloons[k];
+		if (!b.setup_complete) continue;
+
+		const Vertices& V = b.vertices;
+		for (int i = 0; i < b.count_vertices; i++)
+		{
+			double nx, ny, nz;
+			vertex_normal(b, i, nx, ny, nz);
+
+			out.f32((float)V.x[i]); out.f32((float)V.y[i]); out.f32((float)V.z[i]);
+			out.f32((float)nx); out.f32((float)ny); out.f32((float)nz);
+		}
+	}
+
+	// indices over the whole file
+	int first = 0;
+
+	for (k = 0; k < n; k++)
+	{
+		const Balloon& b = balloons[k];
+		if (!b.setup_complete) continue;
+
+		for (int i = 0; i < b.count; i++)
+		{
+			const Triangle& T = b.mesh[i];
+			double nx, ny, nz;
+			face_normal(b, T, nx, ny, nz);
+
+			out.u8(3);
+			out.u32(first + T.a); out.u32(first + T.b); out.u32(first + T.c);
+			out.f32((float)nx); out.f32((float)ny); out.f32((float)nz);
+			out.u8(channel(T.R)); out.u8(channel(T.G)); out.u8(channel(T.B)); out.u8(channel(T.A));
+		}
+
+		first += b.count_vertices;
+	}
+
+	return close_binary(stream, out);
+}
+
+
+// ***********************************************************
+//							.stl
+// ***********************************************************
+bool write_stl(const char *filename, const Balloon *balloons, int n)
+{
+	STATS(PhaseTimer timer(PHASE_EXPORT);)
+
+	FILE *stream = open_binary(filename);
+	if (!stream) return false;
+
+	Writer out(stream);
+	unsigned int triangles = 0;
+	int k;
+
+	for (k = 0; k < n; k++)
+		if (balloons[k].setup_complete) triangles += balloons[k].count;
+
+	// 80 bytes of header, must not start with "solid"
+	char header[80];
+	memset(header, 0, sizeof(header));
+	strcpy(header, "balloon modelling mesh");
+	out.bytes(header, sizeof(header));
+	out.u32(triangles);
+
+	for (k = 0; k < n; k++)
+	{
+		const Balloon& b = balloons[k];
+		if (!b.setup_complete) continue;
+
+		const Vertices& V = b.vertices;
+		for (int i = 0; i < b.count; i++)
+		{
+			const Triangle& T = b.mesh[i];
+			double nx, ny, nz;
+			face_normal(b, T, nx, ny, nz);
+
+			out.f32((float)nx); out.f32((float)ny); out.f32((float)nz);
+			out.f32((float)V.x[T.a]); out.f32((float)V.y[T.a]); out.f32((float)V.z[T.a]);
+			out.f32((float)V.x[T.b]); out.f32((float)V.y[T.b]); out.f32((float)V.z[T.b]);
+			out.f32((float)V.x[T.c]); out.f32((float)V.y[T.c]); out.f32((float)V.z[T.c]);
+			out.u16(0);
+		}
+	}
+
+	return close_binary(stream, out);
+}
+
+
+// ***********************************************************
+//							raw
+// ***********************************************************
+bool write_raw(const char *filename, const Balloon *balloons, int n)
+{
+	STATS(PhaseTimer timer(PHASE_EXPORT);)
+
+	FILE *stream = open_binary(filename);
+	if (!stream) return false;
+
+	Writer out(stream);
+	int k, used = 0;
+
+	for (k = 0; k < n; k++)
+		if (balloons[k].setup_complete) used++;
+
+	// where the blocks go - table first, then the blocks balloon by balloon
+	size_t offset = 64 + 64*(size_t)used;
+
+	char magic[8] = RAW_MESH_MAGIC;
+	out.bytes(magic, 8);
+	out.u32(RAW_MESH_VERSION);
+	out.u32(used);
+	out.pad(64);
+
+	for (k = 0; k < n; k++)
+	{
+		const Balloon& b = balloons[k];
+		if (!b.setup_complete) continue;
+
+		size_t vertex_block = offset;
+		size_t triangle_block = Arena::rounded(vertex_block + 6*sizeof(double)*b.count_vertices);
+		offset = Arena::rounded(triangle_block + (16 + 3*sizeof(double))*b.count);
+
+		out.u32(b.count_vertices);
+		out.u32(b.count);
+		out.u64(vertex_block);
+		out.u64(triangle_block);
+		out.f64(b.x); out.f64(b.y); out.f64(b.z);
+		out.f64(b.radius);
+		out.f64(b.pressure);
+	}
+
+	for (k = 0; k < n; k++)
+	{
+		const Balloon& b = balloons[k];
+		if (!b.setup_complete) continue;
+
+		// the six arrays are one block in memory
+		out.doubles(b.vertices.x, 6*(size_t)b.count_vertices);
+		out.pad(64);
+
+		int i;
+		for (i = 0; i < b.count; i++)
+		{
+			const Triangle& T = b.mesh[i];
+			out.u32(T.a); out.u32(T.b); out.u32(T.c);
+			out.u8(T.flat ? 1 : 0);
+			out.u8(channel(T.R)); out.u8(channel(T.G)); out.u8(channel(T.B));
+		}
+		for (i = 0; i < b.count; i++)
+		{
+			const Triangle& T = b.mesh[i];
+			out.f64(T.nx); out.f64(T.ny); out.f64(T.nz);
+		}
+		out.pad(64);
+	}
+
+	return close_binary(stream, out);
+}
+
+
+// ***********************************************************
+//							by name
+// ***********************************************************
+// does the name end with ext (any case)?
+static bool ends_with(const char *name, const char *ext)
+{
+	size_t n = strlen(name), e = strlen(ext);
+	if (n < e) return false;
+
+	for (size_t i = 0; i < e; i++)
+	{
+		char c = name[n - e + i];
+		if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+		if (c != ext[i]) return false;
+	}
+	return true;
+}
+
+bool write_mesh(const char *filename, const Balloon *balloons, int n)
+{
+	if (ends_with(filename, ".ply")) return write_ply(filename, balloons, n);
+	if (ends_with(filename, ".stl")) return write_stl(filename, balloons, n);
+	if (ends_with(filename, ".raw")) return write_raw(filename, balloons, n);
+	return write_obj(filename, balloons, n);
+}
@@ -0,0 +1,48 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "balloon.h"
+
+// write the meshes of the balloons to a file, false if it cannot be written.
+// all balloons go into one file, the ones not set up are left out.
+
+// Wavefront .obj - one object per balloon, shared vertices, the vertex
+// normals of smooth triangles and the face normals of flat ones. a vertex
+// normal is the unit vector from the balloon's centre to the vertex.
+bool write_obj(const char *filename, const Balloon *balloons, int n);
+
+// binary little endian .ply - one mesh. vertices: float x y z nx ny nz
+// (the unit vector from the centre, as in .obj), faces: the vertex indices,
+// the face normal as float nx ny nz and the colour as uchar red green blue
+// alpha
+bool write_ply(const char *filename, const Balloon *balloons, int n);
+
+// binary .stl - float normal and corners of every triangle, the normal
+// computed from the corners (0 for the degenerate ones at the poles)
+bool write_stl(const char *filename, const Balloon *balloons, int n);
+
+// raw little endian layout to mmap. every block starts on a 64 byte
+// boundary, offsets are from the start of the file.
+//   header (64 bytes): char magic[8] "BALMESH", uint32 version (1),
+//       uint32 number of balloons, zeros
+//   per balloon (64 bytes): uint32 vertices, uint32 triangles,
+//       uint64 vertex block, uint64 triangle block,
+//       double x, y, z, radius, pressure
+//   vertex block: double x[vertices], y[], z[], nx[], ny[], nz[] - the
+//       balloon's own vertex storage as it is in memory (widened to
+//       double in a BALLOON_FLOAT build). nx, ny, nz are the position
+//       over the radius as setup stores them - unit normals only for a
+//       balloon at the origin, the others need their (x, y, z)/radius
+//       subtracted
+//   triangle block: per triangle int32 a, b, c, uint8 flat, uint8 red,
+//       green, blue; then double nx, ny, nz per triangle (the face
+//       normals, valid where flat is 1)
+#define RAW_MESH_MAGIC "BALMESH"
+#define RAW_MESH_VERSION 1
+
+bool write_raw(const char *filename, const Balloon *balloons, int n);
+
+// one of the above, chosen by the extension (.obj .ply .stl .raw)
+bool write_mesh(const char *filename, const Balloon *balloons, int n);
+
+#endif
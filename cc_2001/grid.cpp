@@ -0,0 +1,145 @@
+#include "grid.h"
+#include <stdlib.h>
+
+// keep the grid small, it is rebuilt for every deform call
+#define MAX_CELLS (1 << 18)
+
+
+// ***********************************************************
+//							SphereGrid
+// ***********************************************************
+SphereGrid::SphereGrid()
+{
+	nx = ny = nz = 0;
+	start = 0;
+	item = 0;
+}
+
+SphereGrid::~SphereGrid()
+{
+	delete[] start;
+	delete[] item;
+}
+
+// truncation instead of floor is fine - everything below 0 ends up in 0
+static int clamp(int i, int n)
+{
+	if (i < 0) return 0;
+	if (i >= n) return n - 1;
+	return i;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double da = *(const double *)a, db = *(const double *)b;
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+void SphereGrid::build(const Sphere *spheres, int n, const Bounds& clip)
+{
+	delete[] start;
+	delete[] item;
+
+	ox = clip.min_x; oy = clip.min_y; oz = clip.min_z;
+	max_x = clip.max_x; max_y = clip.max_y; max_z = clip.max_z;
+
+	double ex = max_x - ox, ey = max_y - oy, ez = max_z - oz;
+	int i;
+
+	// cells about as big as the median sphere - a few huge ones
+	// (like a floor) must not make the cells huge too
+	double size = 0;
+	if (n > 0)
+	{
+		double *diameters = new double[n];
+		for (i = 0; i < n; i++) diameters[i] = 2*spheres[i].radius;
+		qsort(diameters, n, sizeof(double), compare_doubles);
+		size = diameters[n/2];
+		delete[] diameters;
+	}
+	double largest = ex > ey ? (ex > ez ? ex : ez) : (ey > ez ? ey : ez);
+	if (size <= 0) size = largest;
+	if (size <= 0) size = 1;
+	while ((ex/size + 1)*(ey/size + 1)*(ez/size + 1) > MAX_CELLS) size *= 2;
+
+	inv_size = 1.0 / size;
+	nx = (int)(ex*inv_size) + 1;
+	ny = (int)(ey*inv_size) + 1;
+	nz = (int)(ez*inv_size) + 1;
+
+	// the last cell is the one outside of clip
+	int cells = nx*ny*nz + 1;
+	start = new int[cells + 1];
+	for (i = 0; i <= cells; i++) start[i] = 0;
+
+	// count, then fill - in sphere order, so every cell stays sorted
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (i = 0; i < n; i++)
+		{
+			const Sphere& s = spheres[i];
+
+			if (s.x - s.radius < ox || s.x + s.radius > max_x ||
+				s.y - s.radius < oy || s.y + s.radius > max_y ||
+				s.z - s.radius < oz || s.z + s.radius > max_z)
+			{
+				if (pass == 0)
+					start[cells]++;
+				else
+					item[start[cells - 1]++] = i;
+			}
+
+			if (s.x + s.radius < ox || s.x - s.radius > max_x) continue;
+			if (s.y + s.radius < oy || s.y - s.radius > max_y) continue;
+			if (s.z + s.radius < oz || s.z - s.radius > max_z) continue;
+
+			int x0 = clamp((int)((s.x - s.radius - ox)*inv_size), nx);
+			int x1 = clamp((int)((s.x + s.radius - ox)*inv_size), nx);
+			int y0 = clamp((int)((s.y - s.radius - oy)*inv_size), ny);
+			int y1 = clamp((int)((s.y + s.radius - oy)*inv_size), ny);
+			int z0 = clamp((int)((s.z - s.radius - oz)*inv_size), nz);
+			int z1 = clamp((int)((s.z + s.radius - oz)*inv_size), nz);
+
+			for (int cz = z0; cz <= z1; cz++)
+				for (int cy = y0; cy <= y1; cy++)
+					for (int cx = x0; cx <= x1; cx++)
+					{
+						int c = (cz*ny + cy)*nx + cx;
+						if (pass == 0)
+							start[c + 1]++;
+						else
+							item[start[c]++] = i;
+					}
+		}
+
+		if (pass == 0)
+		{
+			for (i = 0; i < cells; i++) start[i + 1] += start[i];
+			item = new int[start[cells]];
+		}
+		else
+		{
+			// filling moved every start to the next cell's one
+			for (i = cells; i > 0; i--) start[i] = start[i - 1];
+			start[0] = 0;
+		}
+	}
+}
+
+int SphereGrid::cell(double x, double y, double z) const
+{
+	if (x < ox || x > max_x || y < oy || y > max_y || z < oz || z > max_z)
+		return nx*ny*nz;
+
+	int cx = clamp((int)((x - ox)*inv_size), nx);
+	int cy = clamp((int)((y - oy)*inv_size), ny);
+	int cz = clamp((int)((z - oz)*inv_size), nz);
+
+	return (cz*ny + cy)*nx + cx;
+}
+
+const int *SphereGrid::items(int cell, int& n) const
+{
+	n = start[cell + 1] - start[cell];
+	return item + start[cell];
+}
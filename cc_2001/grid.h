@@ -0,0 +1,44 @@
+#ifndef GRID_H
+#define GRID_H
+
+struct Sphere
+{
+	double x, y, z;
+	double radius;
+};
+
+#include "balloon.h"
+
+// uniform grid over a set of spheres - every cell lists (in ascending
+// order) the spheres whose bounding box overlaps it. the grid only
+// covers the clip box, one extra cell holds all the spheres reaching
+// outside of it.
+class SphereGrid
+{
+public:
+	SphereGrid();
+	~SphereGrid();
+
+	// sort the spheres into cells
+	void build(const Sphere *spheres, int n, const Bounds& clip);
+
+	// cell containing the point (the extra one if outside of clip)
+	int cell(double x, double y, double z) const;
+
+	// spheres of a cell
+	const int *items(int cell, int& n) const;
+
+private:
+	// covered box
+	double ox, oy, oz;
+	double max_x, max_y, max_z;
+
+	double inv_size;
+	int nx, ny, nz;
+
+	// cell i owns item[start[i]] .. item[start[i+1]-1]
+	int *start;
+	int *item;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "loader.h"
+#include <string.h>
+
+
+// ***********************************************************
+//							Loader
+// ***********************************************************
+Loader::Loader()
+{
+	scene = 0;
+	filename[0] = 0;
+	everything = false;
+	levels = 1;
+
+	balloons = 0;
+	count_preview = 0;
+	shown = 0;
+	done = false;
+	ok = false;
+
+	progress.done = 0;
+	progress.total = 0;
+	progress.stage = "";
+	progress.cancel = false;
+}
+
+Loader::~Loader()
+{
+	stop();
+}
+
+void Loader::start(Scene& scene, const char *filename, bool everything, int levels)
+{
+	stop();
+
+	this->scene = &scene;
+	strncpy(this->filename, filename, sizeof(this->filename) - 1);
+	this->filename[sizeof(this->filename) - 1] = 0;
+	this->everything = everything;
+	this->levels = levels;
+
+	ok = false;
+	done = false;
+	progress.done = 0;
+	progress.total = 0;
+	progress.stage = "reading";
+	progress.cancel = false;
+
+	thread = std::thread(&Loader::run, this);
+}
+
+void Loader::stop()
+{
+	// the scene gives up at its next step - no waiting for all of it
+	if (thread.joinable())
+	{
+		progress.cancel = true;
+		thread.join();
+	}
+
+	// the balloons first, their meshes live in the arena
+	shown = 0;
+	delete[] balloons;
+	balloons = 0;
+	count_preview = 0;
+	arena.release();
+}
+
+double Loader::fraction() const
+{
+	int total = progress.total;
+	if (total <= 0) return 0;
+
+	double f = (double)progress.done/total;
+	return f < 1 ? f : 1;
+}
+
+const char *Loader::stage() const
+{
+	return progress.stage;
+}
+
+void Loader::run()
+{
+	if (!scene->read(filename))
+	{
+		done.store(true, std::memory_order_release);
+		return;
+	}
+
+	// the coarse spheres to show meanwhile
+	int n = scene->count;
+	int segments = scene->segments < PREVIEW_LATTICE ? scene->segments : PREVIEW_LATTICE;
+	int pies = scene->pies < PREVIEW_LATTICE ? scene->pies : PREVIEW_LATTICE;
+
+	balloons = new Balloon[n];
+	arena.reserve(n*Balloon::storage_size(segments, pies));
+	for (int i = 0; i < n; i++)
+	{
+		const Balloon& b = scene->balloons[i];
+		balloons[i].x = b.x; balloons[i].y = b.y; balloons[i].z = b.z;
+		balloons[i].radius = b.radius; balloons[i].pressure = b.pressure;
+		balloons[i].setup(segments, pies, i == 0 ? scene->object_color : scene->around_color, &arena);
+	}
+	count_preview = n;
+	shown.store(balloons, std::memory_order_release);
+
+	// setup and deform are one step per balloon, so is every level
+	if (scene->count_keys == 0)
+	{
+		int steps = levels < 1 ? 1 : (levels > SCENE_LEVELS ? SCENE_LEVELS : levels);
+		progress.total = 2*n*steps;
+		scene->progress = &progress;
+
+		progress.stage = "setup";
+		scene->setup();
+		progress.stage = "deforming";
+		scene->deform(everything);
+		progress.stage = "levels of detail";
+		scene->build_levels(levels);
+
+		scene->progress = 0;
+		if (progress.cancel)
+		{
+			progress.stage = "canceled";
+			done.store(true, std::memory_order_release);
+			return;
+		}
+		progress.done = (int)progress.total;
+	}
+
+	progress.stage = "done";
+	ok = true;
+	done.store(true, std::memory_order_release);
+}
@@ -0,0 +1,59 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include "scene.h"
+#include <atomic>
+#include <thread>
+
+// lattice of the preview (or the file's, if that is coarser)
+#define PREVIEW_LATTICE 16
+
+// reads, sets up and deforms a scene on a thread of its own, so the
+// window showing it keeps running. right after reading it sets up a
+// coarse undeformed copy of the balloons to show until the scene is done.
+// a scene with keys is only read - its frames come from Animation.
+class Loader
+{
+public:
+	Loader();
+	~Loader();
+
+	// load filename into scene (deform(everything), build_levels(levels)).
+	// the scene is the thread's until finished() says true.
+	void start(Scene& scene, const char *filename, bool everything, int levels);
+
+	// stop the thread (the scene is left half done then, ok false) and
+	// free the preview
+	void stop();
+
+	// the undeformed balloons, 0 until the file is read (and when it
+	// cannot be). they do not change any more once there.
+	const Balloon *preview() const { return shown.load(std::memory_order_acquire); }
+	int count_preview;
+
+	// the thread is done - ok says if the scene could be read
+	bool finished() const { return done.load(std::memory_order_acquire); }
+	bool ok;
+
+	// 0 .. 1 of the work after reading, and what is being done
+	double fraction() const;
+	const char *stage() const;
+
+private:
+	void run();
+
+	Scene *scene;
+	char filename[1024];
+	bool everything;
+	int levels;
+
+	Balloon *balloons;
+	Arena arena;
+	std::atomic<Balloon *> shown;
+	std::atomic<bool> done;
+
+	Progress progress;
+	std::thread thread;
+};
+
+#endif
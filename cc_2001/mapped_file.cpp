@@ -0,0 +1,128 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// an empty file maps to this
+static const char nothing[1] = { 0 };
+
+
+// ***********************************************************
+//							MappedFile
+// ***********************************************************
+MappedFile::MappedFile()
+{
+	bytes = 0;
+	length = 0;
+#ifdef _WIN32
+	file = INVALID_HANDLE_VALUE;
+	mapping = 0;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char *filename, bool writable)
+{
+	close();
+
+	file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+					   FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		close();
+		return false;
+	}
+
+	length = (size_t)size.QuadPart;
+	if (length == 0)
+	{
+		bytes = nothing;
+		return true;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, writable ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+	if (mapping) bytes = (const char *)MapViewOfFile(mapping, writable ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+	if (!bytes)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (bytes && bytes != nothing) UnmapViewOfFile(bytes);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+
+	bytes = 0;
+	length = 0;
+	file = INVALID_HANDLE_VALUE;
+	mapping = 0;
+}
+
+#else
+
+bool MappedFile::open(const char *filename, bool writable)
+{
+	close();
+
+	int fd = ::open(filename, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))
+	{
+		::close(fd);
+		return false;
+	}
+
+	length = (size_t)info.st_size;
+	if (length == 0)
+	{
+		::close(fd);
+		bytes = nothing;
+		return true;
+	}
+
+	void *p = mmap(0, length, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (p == MAP_FAILED)
+	{
+		length = 0;
+		return false;
+	}
+
+	// read once from the front to the back
+	madvise(p, length, MADV_SEQUENTIAL);
+
+	bytes = (const char *)p;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (bytes && bytes != nothing) munmap((void *)bytes, length);
+
+	bytes = 0;
+	length = 0;
+}
+
+#endif
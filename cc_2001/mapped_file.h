@@ -0,0 +1,33 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+
+// a whole file mapped read only into memory
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// false if the file cannot be opened or mapped.
+	// writable: the pages can be changed, the copies stay in memory and
+	// never go back to the file
+	bool open(const char *filename, bool writable = false);
+	void close();
+
+	const char *data() const { return bytes; }
+	char *writable_data() const { return (char *)bytes; }
+	size_t size() const { return length; }
+
+private:
+	const char *bytes;
+	size_t length;
+
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#endif
+};
+
+#endif
@@ -0,0 +1,412 @@
+// balloon-offscreen: the viewer's drawing without a window.
+// renders a .bal file into an offscreen buffer (EGL, or OSMesa when built
+// with -DBALLOON_OSMESA) the way the viewer does, reports the time per
+// frame and writes the last frame as a .ppm image.
+
+#include "scene.h"
+#include "animation.h"
+#include "loader.h"
+#include "renderer.h"
+#include "threadpool.h"
+#ifdef BALLOON_OSMESA
+#include <GL/osmesa.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#include <GL/gl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+static void usage()
+{
+	fprintf(stderr,
+		"usage: balloon-offscreen [options] filename.bal\n"
+		"  -all          deform all the balloons, not only the object\n"
+		"  -threads n    number of threads (0 = one per core)\n"
+		"  -size WxH     size of the image (640x480)\n"
+		"  -frames n     frames to draw (100)\n"
+		"  -levels n     levels of detail, 1 = only the file's (4)\n"
+		"  -immediate    draw one vertex at a time like the old viewer\n"
+		"  -animate s    play the keys of the file, s seconds of it per frame\n"
+		"  -async        load on another thread, drawing a preview meanwhile\n"
+		"  -o file       write the last frame (.ppm)\n");
+}
+
+
+// ***********************************************************
+//							context
+// ***********************************************************
+#ifdef BALLOON_OSMESA
+
+static OSMesaContext context = 0;
+static unsigned char *buffer = 0;
+
+static bool open_context(int width, int height)
+{
+	context = OSMesaCreateContextExt(OSMESA_RGBA, 24, 0, 0, NULL);
+	if (!context) return false;
+
+	buffer = new unsigned char[4*(size_t)width*height];
+	return OSMesaMakeCurrent(context, buffer, GL_UNSIGNED_BYTE, width, height) != 0;
+}
+
+static void close_context()
+{
+	if (context) OSMesaDestroyContext(context);
+	delete[] buffer;
+}
+
+static void *loader(const char *name)
+{
+	return (void *)OSMesaGetProcAddress(name);
+}
+
+#else
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLSurface surface = EGL_NO_SURFACE;
+static EGLContext context = EGL_NO_CONTEXT;
+
+static bool open_context(int width, int height)
+{
+	// no window system at all if Mesa can do that
+	PFNEGLGETPLATFORMDISPLAYEXTPROC platform_display =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	if (platform_display) display = platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+#endif
+	if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) return false;
+	if (!eglBindAPI(EGL_OPENGL_API)) return false;
+
+	const EGLint attributes[] =
+	{
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 16,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configs = 0;
+	if (!eglChooseConfig(display, attributes, &config, 1, &configs) || configs < 1) return false;
+
+	const EGLint size[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+	surface = eglCreatePbufferSurface(display, config, size);
+	if (surface == EGL_NO_SURFACE) return false;
+
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, 0);
+	if (context == EGL_NO_CONTEXT) return false;
+
+	return eglMakeCurrent(display, surface, surface, context) != 0;
+}
+
+static void close_context()
+{
+	if (display == EGL_NO_DISPLAY) return;
+
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+	if (surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+	eglTerminate(display);
+}
+
+static void *loader(const char *name)
+{
+	return (void *)eglGetProcAddress(name);
+}
+
+#endif
+
+
+// ***********************************************************
+//							drawing
+// ***********************************************************
+
+// the state InitGL and ReSizeGLScene of the viewer set up
+static void init_gl(int width, int height)
+{
+	glViewport(0, 0, width, height);
+
+	// gluPerspective(45, aspect, 0.1, 100)
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	double top = 0.1*tan(45.0/2*3.14159265358979323846/180);
+	double aspect = (double)width/height;
+	glFrustum(-top*aspect, top*aspect, -top, top, 0.1, 100.0);
+
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	glShadeModel(GL_SMOOTH);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.5f);
+	glClearDepth(1.0f);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+	glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
+	glEnable(GL_LIGHT0);
+	glEnable(GL_LIGHTING);
+	glEnable(GL_COLOR_MATERIAL);
+}
+
+// the camera of DrawGLScene
+static void start_frame(float rot)
+{
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glLoadIdentity();
+	glTranslatef(0.0f, 0.0f, -10.0f);
+	glRotatef(rot, 1.0f, 0.0f, 0.0f);
+	glRotatef(rot*1.5f, 0.0f, 1.0f, 0.0f);
+}
+
+static bool write_ppm(const char *filename, int width, int height)
+{
+	unsigned char *pixels = new unsigned char[3*(size_t)width*height];
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+
+	FILE *stream = fopen(filename, "wb");
+	bool ok = stream != 0;
+	if (ok)
+	{
+		fprintf(stream, "P6\n%d %d\n255\n", width, height);
+
+		// OpenGL starts at the bottom
+		for (int y = height - 1; y >= 0; y--)
+			if (fwrite(pixels + 3*(size_t)width*y, 1, 3*(size_t)width, stream) != 3*(size_t)width) ok = false;
+
+		if (fclose(stream) != 0) ok = false;
+	}
+
+	delete[] pixels;
+	return ok;
+}
+
+// milliseconds since start
+static double elapsed(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+	bool everything = false;
+	bool immediate = false;
+	bool async = false;
+	int width = 640, height = 480;
+	int frames = 100;
+	int levels = SCENE_LEVELS;
+	double animate = 0;
+	const char *output = 0;
+	const char *input = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-all") == 0) everything = true;
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) set_thread_count(atoi(argv[++i]));
+		else if (strcmp(argv[i], "-size") == 0 && i + 1 < argc)
+		{
+			if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width < 1 || height < 1)
+			{
+				usage();
+				return 2;
+			}
+		}
+		else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-levels") == 0 && i + 1 < argc) levels = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-immediate") == 0) immediate = true;
+		else if (strcmp(argv[i], "-animate") == 0 && i + 1 < argc) animate = atof(argv[++i]);
+		else if (strcmp(argv[i], "-async") == 0) async = true;
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) output = argv[++i];
+		else if (argv[i][0] == '-' || input)
+		{
+			usage();
+			return 2;
+		}
+		else input = argv[i];
+	}
+
+	if (!input || frames < 1 || animate < 0)
+	{
+		usage();
+		return 2;
+	}
+
+	Scene scene;
+	if (!async && !scene.read(input))
+	{
+		fprintf(stderr, "balloon-offscreen: %s\n", scene.error());
+		return 1;
+	}
+
+	// the frames of an animation come from its own thread, one level only
+	Animation animation;
+	if (async);
+	else if (animate > 0) animation.start(scene, animate, everything);
+	else
+	{
+		scene.setup();
+		scene.deform(everything);
+		if (!immediate) scene.build_levels(levels);
+	}
+
+	if (!open_context(width, height))
+	{
+		fprintf(stderr, "balloon-offscreen: no offscreen OpenGL context\n");
+		close_context();
+		return 1;
+	}
+
+	init_gl(width, height);
+
+	Renderer renderer;
+	renderer.init(loader);
+
+	// -async: drawing from the start, the preview as soon as the file is
+	// read, the scene once it is deformed
+	float rot = 0;
+	int loading_frames = 0;
+	double preview_ms = -1, loaded_ms = 0;
+	const char *stages[8];
+	double stage_ms[8];
+	int count_stages = 0;
+
+	if (async)
+	{
+		Loader loading;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		loading.start(scene, input, everything, immediate ? 1 : levels);
+
+		while (!loading.finished())
+		{
+			const char *stage = loading.stage();
+			if (count_stages < 8 && (count_stages == 0 || stage != stages[count_stages - 1]))
+			{
+				stages[count_stages] = stage;
+				stage_ms[count_stages++] = elapsed(start);
+			}
+
+			const Balloon *preview = loading.preview();
+			if (preview && preview_ms < 0)
+			{
+				if (!immediate) renderer.upload(preview, loading.count_preview);
+				preview_ms = elapsed(start);
+			}
+
+			start_frame(rot);
+			if (preview && immediate)
+				renderer.draw_immediate(preview, loading.count_preview, scene.object_style, scene.around_style);
+			else if (preview)
+				renderer.draw(scene.object_style, scene.around_style);
+			renderer.draw_progress(loading.fraction());
+			glFinish();
+			loading_frames++;
+			rot += 1.0f;
+		}
+		loading.stop();
+		loaded_ms = elapsed(start);
+
+		if (!loading.ok)
+		{
+			fprintf(stderr, "balloon-offscreen: %s\n", scene.error());
+			renderer.release();
+			close_context();
+			return 1;
+		}
+
+		if (animate > 0) animation.start(scene, animate, everything);
+	}
+
+	// the first frame of an animation before the clock starts
+	const Balloon *balloons = scene.balloons;
+	const Frame *shown = animate > 0 ? animation.next() : 0;
+	if (shown) balloons = shown->balloons;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (!immediate)
+	{
+		if (shown) renderer.upload(balloons, scene.count);
+		else renderer.upload(scene.level, scene.count_levels, scene.count);
+	}
+	glFinish();
+	double upload_ms = elapsed(start);
+
+	long long triangles = 0;
+	int uploads = 0;
+	double animation_ms = 0;
+	start = std::chrono::steady_clock::now();
+	for (int f = 0; f < frames; f++)
+	{
+		// whatever the other thread has finished by now - a new frame is
+		// always in the other buffer
+		if (shown)
+		{
+			const Frame *latest = animation.latest();
+			if (latest != shown)
+			{
+				shown = latest;
+				balloons = shown->balloons;
+				if (!immediate) renderer.upload(balloons, scene.count);
+				animation_ms += shown->milliseconds;
+				uploads++;
+			}
+		}
+
+		start_frame(rot);
+		if (immediate)
+			renderer.draw_immediate(balloons, scene.count, scene.object_style, scene.around_style);
+		else
+			renderer.draw(scene.object_style, scene.around_style);
+		glFinish();
+		triangles += renderer.triangles;
+
+		rot += 1.0f;
+	}
+	double draw_ms = elapsed(start);
+	int computed = animation.computed;
+	animation.stop();
+
+	printf("%s: %d balloons, %s, %s\n", input, scene.count,
+		   (const char *)glGetString(GL_RENDERER), (const char *)glGetString(GL_VERSION));
+	if (immediate)
+		printf("immediate mode\n");
+	else
+	{
+		printf("%s, instancing %s: %d instances, %d draw calls per frame\n",
+			   renderer.buffers() ? "buffer objects" : "vertex arrays",
+			   renderer.instancing() ? "on" : "off", renderer.instances, renderer.draw_calls);
+		printf("%d levels of detail, %lld triangles per frame\n", animate > 0 ? 1 : scene.count_levels, triangles/frames);
+	}
+	if (animate > 0)
+		printf("animation: %d frames computed, %d of them drawn, %.3f ms each to compute\n",
+			   computed, uploads, uploads ? animation_ms/uploads : 0.0);
+	if (async)
+	{
+		if (preview_ms >= 0)
+			printf("async: preview after %.3f ms, the scene after %.3f ms, %d frames drawn meanwhile\n",
+				   preview_ms, loaded_ms, loading_frames);
+		else
+			printf("async: the scene after %.3f ms, before any preview\n", loaded_ms);
+		for (int k = 0; k < count_stages; k++)
+			printf("  %-18s from %10.3f ms\n", stages[k], stage_ms[k]);
+	}
+	printf("upload  %10.3f ms\n", upload_ms);
+	printf("frame   %10.3f ms (%d frames)\n", draw_ms/frames, frames);
+
+	bool ok = true;
+	if (output && !write_ppm(output, width, height))
+	{
+		fprintf(stderr, "balloon-offscreen: cannot write %s\n", output);
+		ok = false;
+	}
+
+	renderer.release();
+	close_context();
+	return ok ? 0 : 1;
+}
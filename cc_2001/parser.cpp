@@ -0,0 +1,213 @@
+#include "parser.h"
+#include "balloon.h"
+#include <charconv>
+#include <ctype.h>
+#include <stdio.h>
+
+
+// ***********************************************************
+//							BalParser
+// ***********************************************************
+BalParser::BalParser()
+{
+	p = end = line_start = 0;
+	line = 1;
+	balloons = left = 0;
+	message[0] = 0;
+}
+
+bool BalParser::open(const char *filename)
+{
+	close();
+
+	if (!file.open(filename))
+	{
+		snprintf(message, sizeof(message), "cannot open %s", filename);
+		return false;
+	}
+
+	p = line_start = file.data();
+	end = p + file.size();
+	return true;
+}
+
+void BalParser::close()
+{
+	file.close();
+	p = end = line_start = 0;
+	line = 1;
+	balloons = left = 0;
+	message[0] = 0;
+}
+
+void BalParser::fail(const char *at, const char *what)
+{
+	snprintf(message, sizeof(message), "%d:%d: %s", line, (int)(at - line_start) + 1, what);
+}
+
+bool BalParser::skip_space()
+{
+	while (p < end)
+	{
+		char c = *p;
+		if (c == '\n')
+		{
+			line++;
+			line_start = ++p;
+		}
+		else if (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f') p++;
+		else return true;
+	}
+	return false;
+}
+
+template <class T> bool BalParser::number(T& value, const char *what)
+{
+	if (!skip_space())
+	{
+		fail(p, what);
+		return false;
+	}
+
+	// fscanf takes a leading +, from_chars does not - but only before the
+	// digits, "+-1" is no number
+	const char *start = p;
+	if (*p == '+')
+	{
+		if (p + 1 < end && (isdigit((unsigned char)p[1]) || p[1] == '.')) p++;
+		else
+		{
+			fail(start, "malformed number");
+			return false;
+		}
+	}
+
+	std::from_chars_result r = std::from_chars(p, end, value);
+	if (r.ec != std::errc())
+	{
+		p = start;
+		fail(start, what);
+		return false;
+	}
+
+	// the whole word must be the number - "2x" is wrong where the x is
+	if (r.ptr < end && !isspace((unsigned char)*r.ptr))
+	{
+		p = start;
+		fail(r.ptr, "unexpected character after a number");
+		return false;
+	}
+
+	p = r.ptr;
+	return true;
+}
+
+bool BalParser::header(BalHeader& h)
+{
+	int object_color, around_color;
+
+	if (!number(h.count, "number of balloons expected")) return false;
+	if (h.count < 1)
+	{
+		fail(p, "at least one balloon needed");
+		return false;
+	}
+
+	if (!number(h.segments, "segments expected")) return false;
+	if (!number(h.pies, "pies expected")) return false;
+	if (h.segments < 1 || h.pies < 1)
+	{
+		fail(p, "segments and pies must be at least 1");
+		return false;
+	}
+	if (!Balloon::lattice_fits(h.segments, h.pies))
+	{
+		fail(p, "too many segments and pies, the lattice does not fit in memory");
+		return false;
+	}
+
+	if (!number(object_color, "object colour flag expected")) return false;
+	if (!number(around_color, "colour flag of the other balloons expected")) return false;
+	if (!number(h.object_style, "object style expected")) return false;
+	if (!number(h.around_style, "style of the other balloons expected")) return false;
+
+	h.object_color = object_color != 0;
+	h.around_color = around_color != 0;
+
+	balloons = left = h.count;
+	return true;
+}
+
+bool BalParser::next(BalBalloon& b)
+{
+	if (left <= 0) return false;
+
+	// the count of the header is only a promise, it is checked here
+	if (!skip_space())
+	{
+		char what[64];
+		snprintf(what, sizeof(what), "file ends after %d of %d balloons", balloons - left, balloons);
+		fail(p, what);
+		return false;
+	}
+
+	if (!number(b.x, "x of a balloon expected")) return false;
+	if (!number(b.y, "y of a balloon expected")) return false;
+	if (!number(b.z, "z of a balloon expected")) return false;
+	if (!number(b.radius, "radius expected")) return false;
+	if (!number(b.pressure, "pressure expected")) return false;
+
+	left--;
+	return true;
+}
+
+bool BalParser::keys(int& count)
+{
+	count = 0;
+	if (left > 0)
+	{
+		fail(p, "balloons missing before the keys");
+		return false;
+	}
+
+	// no animation
+	if (!skip_space()) return true;
+
+	if (!number(count, "number of keys expected")) return false;
+	if (count < 0)
+	{
+		fail(p, "number of keys must not be negative");
+		return false;
+	}
+
+	left = count;
+	return true;
+}
+
+bool BalParser::next_key(BalKey& k)
+{
+	if (left <= 0) return false;
+
+	if (!number(k.balloon, "balloon of a key expected")) return false;
+	if (k.balloon < 0 || k.balloon >= balloons)
+	{
+		fail(p, "no balloon with this number");
+		return false;
+	}
+
+	if (!number(k.time, "time of a key expected")) return false;
+	if (!(k.time > 0))
+	{
+		fail(p, "time of a key must be after 0");
+		return false;
+	}
+
+	if (!number(k.x, "x of a key expected")) return false;
+	if (!number(k.y, "y of a key expected")) return false;
+	if (!number(k.z, "z of a key expected")) return false;
+	if (!number(k.radius, "radius of a key expected")) return false;
+	if (!number(k.pressure, "pressure of a key expected")) return false;
+
+	left--;
+	return true;
+}
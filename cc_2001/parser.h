@@ -0,0 +1,82 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "mapped_file.h"
+
+// first lines of a .bal file
+struct BalHeader
+{
+	int count;
+	int segments, pies;
+	bool object_color, around_color;
+	int object_style, around_style;
+};
+
+// one balloon line
+struct BalBalloon
+{
+	double x, y, z;
+	double radius;
+	double pressure;
+};
+
+// one key of an animation, after the balloons
+struct BalKey
+{
+	int balloon;
+	double time;
+	double x, y, z;
+	double radius;
+	double pressure;
+};
+
+// reads a .bal file straight from memory, one balloon at a time.
+// numbers are separated by any white space, like fscanf reads them.
+// on malformed input the calls return false and error() tells where.
+class BalParser
+{
+public:
+	BalParser();
+
+	bool open(const char *filename);
+	void close();
+
+	// the header, must come first
+	bool header(BalHeader& h);
+
+	// the next balloon, false after the last one announced in the header
+	// (error() is empty then) or on an error
+	bool next(BalBalloon& b);
+
+	// after the last balloon: the number of keys that follow, 0 if the
+	// file ends there
+	bool keys(int& count);
+
+	// the next key, false after the last one or on an error
+	bool next_key(BalKey& k);
+
+	// "line:column: what is wrong", empty if nothing is
+	const char *error() const { return message; }
+
+private:
+	// the next number, what goes into the error message
+	template <class T> bool number(T& value, const char *what);
+
+	// start of the next number, false at the end of the file
+	bool skip_space();
+
+	void fail(const char *p, const char *what);
+
+	MappedFile file;
+	const char *p, *end;
+
+	// for the error messages
+	const char *line_start;
+	int line;
+
+	int balloons;	// from the header
+	int left;		// balloons (then keys) still to come
+	char message[256];
+};
+
+#endif
@@ -0,0 +1,309 @@
+#include "png.h"
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// LZ77 window and how hard it looks for matches
+#define WINDOW (1 << 15)
+#define HASH_BITS 15
+#define MAX_CHAIN 16
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+
+
+// ***********************************************************
+//							checksums
+// ***********************************************************
+static unsigned int crc_table[256];
+
+static void make_crc_table()
+{
+	for (unsigned int n = 0; n < 256; n++)
+	{
+		unsigned int c = n;
+		for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+		crc_table[n] = c;
+	}
+}
+
+static unsigned int crc(unsigned int c, const unsigned char *p, size_t n)
+{
+	c = ~c;
+	for (size_t i = 0; i < n; i++) c = crc_table[(c ^ p[i]) & 0xff] ^ (c >> 8);
+	return ~c;
+}
+
+static unsigned int adler(const unsigned char *p, size_t n)
+{
+	unsigned int a = 1, b = 0;
+	while (n > 0)
+	{
+		// 5552 bytes before the sums can overflow
+		size_t part = n < 5552 ? n : 5552;
+		for (size_t i = 0; i < part; i++)
+		{
+			a += p[i];
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+		p += part;
+		n -= part;
+	}
+	return (b << 16) | a;
+}
+
+
+// ***********************************************************
+//							deflate
+// ***********************************************************
+
+// bits go out starting with the lowest one
+class Bits
+{
+public:
+	Bits(std::vector<unsigned char>& out) : out(out), buffer(0), count(0) {}
+
+	void put(unsigned int value, int bits)
+	{
+		buffer |= (unsigned long long)value << count;
+		count += bits;
+		while (count >= 8)
+		{
+			out.push_back((unsigned char)buffer);
+			buffer >>= 8;
+			count -= 8;
+		}
+	}
+
+	// Huffman codes start with the highest bit
+	void code(unsigned int value, int bits)
+	{
+		unsigned int reversed = 0;
+		for (int i = 0; i < bits; i++) reversed |= ((value >> i) & 1) << (bits - 1 - i);
+		put(reversed, bits);
+	}
+
+	void finish()
+	{
+		if (count > 0) out.push_back((unsigned char)buffer);
+		buffer = 0;
+		count = 0;
+	}
+
+private:
+	std::vector<unsigned char>& out;
+	unsigned long long buffer;
+	int count;
+};
+
+static const int length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const int length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const int distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const int distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// a literal or length symbol with the fixed codes
+static void symbol(Bits& bits, int s)
+{
+	if (s < 144) bits.code(0x30 + s, 8);
+	else if (s < 256) bits.code(0x190 + s - 144, 9);
+	else if (s < 280) bits.code(s - 256, 7);
+	else bits.code(0xC0 + s - 280, 8);
+}
+
+static void match(Bits& bits, int length, int distance)
+{
+	int i = 28;
+	while (length_base[i] > length) i--;
+	symbol(bits, 257 + i);
+	if (length_extra[i]) bits.put(length - length_base[i], length_extra[i]);
+
+	int d = 29;
+	while (distance_base[d] > distance) d--;
+	bits.code(d, 5);
+	if (distance_extra[d]) bits.put(distance - distance_base[d], distance_extra[d]);
+}
+
+static unsigned int hash(const unsigned char *p)
+{
+	return ((p[0] << 16 | p[1] << 8 | p[2])*2654435761u) >> (32 - HASH_BITS);
+}
+
+// zlib stream of one fixed Huffman block, greedy matches
+static void deflate(const unsigned char *data, size_t n, std::vector<unsigned char>& out)
+{
+	out.push_back(0x78);
+	out.push_back(0x01);
+
+	Bits bits(out);
+	bits.put(1, 1);			// last block
+	bits.put(1, 2);			// fixed codes
+
+	std::vector<int> head(1 << HASH_BITS, -1);
+	std::vector<int> previous(WINDOW, -1);
+
+	size_t i = 0;
+	while (i < n)
+	{
+		int best = 0, distance = 0;
+
+		if (i + MIN_MATCH <= n)
+		{
+			unsigned int h = hash(data + i);
+			int candidate = head[h];
+			int limit = (int)(n - i < MAX_MATCH ? n - i : MAX_MATCH);
+
+			for (int chain = 0; chain < MAX_CHAIN && candidate >= 0 && i - candidate <= WINDOW - 1; chain++)
+			{
+				const unsigned char *a = data + candidate, *b = data + i;
+				int length = 0;
+				while (length < limit && a[length] == b[length]) length++;
+
+				if (length > best)
+				{
+					best = length;
+					distance = (int)(i - candidate);
+					if (length == limit) break;
+				}
+				candidate = previous[candidate & (WINDOW - 1)];
+			}
+		}
+
+		int step = best >= MIN_MATCH ? best : 1;
+		if (best >= MIN_MATCH) match(bits, best, distance);
+		else symbol(bits, data[i]);
+
+		// remember every position passed
+		for (int k = 0; k < step; k++, i++)
+		{
+			if (i + MIN_MATCH > n) continue;
+			unsigned int h = hash(data + i);
+			previous[i & (WINDOW - 1)] = head[h];
+			head[h] = (int)i;
+		}
+	}
+
+	symbol(bits, 256);
+	bits.finish();
+
+	unsigned int a = adler(data, n);
+	out.push_back((unsigned char)(a >> 24));
+	out.push_back((unsigned char)(a >> 16));
+	out.push_back((unsigned char)(a >> 8));
+	out.push_back((unsigned char)a);
+}
+
+
+// ***********************************************************
+//							png
+// ***********************************************************
+static int paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if (pa <= pb && pa <= pc) return a;
+	return pb <= pc ? b : c;
+}
+
+// every row with the filter that leaves the smallest numbers
+static void filter(const unsigned char *rgb, int width, int height, std::vector<unsigned char>& out)
+{
+	size_t stride = 3*(size_t)width;
+	std::vector<unsigned char> candidate[5];
+	for (int f = 0; f < 5; f++) candidate[f].resize(stride);
+
+	out.resize((stride + 1)*height);
+
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned char *row = rgb + y*stride;
+		const unsigned char *up = y > 0 ? row - stride : 0;
+		long best_sum = -1;
+		int best = 0;
+
+		for (int f = 0; f < 5; f++)
+		{
+			long sum = 0;
+			for (size_t x = 0; x < stride; x++)
+			{
+				int a = x >= 3 ? row[x - 3] : 0;
+				int b = up ? up[x] : 0;
+				int c = up && x >= 3 ? up[x - 3] : 0;
+				int predicted = 0;
+
+				switch (f)
+				{
+				case 1: predicted = a; break;
+				case 2: predicted = b; break;
+				case 3: predicted = (a + b)/2; break;
+				case 4: predicted = paeth(a, b, c); break;
+				}
+
+				unsigned char v = (unsigned char)(row[x] - predicted);
+				candidate[f][x] = v;
+				sum += v < 128 ? v : 256 - v;
+			}
+
+			if (best_sum < 0 || sum < best_sum)
+			{
+				best_sum = sum;
+				best = f;
+			}
+		}
+
+		unsigned char *line = &out[y*(stride + 1)];
+		line[0] = (unsigned char)best;
+		memcpy(line + 1, &candidate[best][0], stride);
+	}
+}
+
+static void chunk(FILE *stream, const char *type, const unsigned char *data, size_t n, bool& ok)
+{
+	unsigned char length[4] = { (unsigned char)(n >> 24), (unsigned char)(n >> 16), (unsigned char)(n >> 8), (unsigned char)n };
+	unsigned int c = crc(crc(0, (const unsigned char *)type, 4), data, n);
+	unsigned char check[4] = { (unsigned char)(c >> 24), (unsigned char)(c >> 16), (unsigned char)(c >> 8), (unsigned char)c };
+
+	if (fwrite(length, 1, 4, stream) != 4) ok = false;
+	if (fwrite(type, 1, 4, stream) != 4) ok = false;
+	if (n && fwrite(data, 1, n, stream) != n) ok = false;
+	if (fwrite(check, 1, 4, stream) != 4) ok = false;
+}
+
+bool write_png(const char *filename, const unsigned char *rgb, int width, int height)
+{
+	STATS(PhaseTimer timer(PHASE_EXPORT);)
+
+	static bool ready = (make_crc_table(), true);
+	(void)ready;
+
+	std::vector<unsigned char> filtered, compressed;
+	filter(rgb, width, height, filtered);
+	deflate(&filtered[0], filtered.size(), compressed);
+
+	FILE *stream = fopen(filename, "wb");
+	if (!stream) return false;
+
+	bool ok = true;
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if (fwrite(signature, 1, 8, stream) != 8) ok = false;
+
+	// 8 bit RGB, not interlaced
+	unsigned char header[13] =
+	{
+		(unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8), (unsigned char)width,
+		(unsigned char)(height >> 24), (unsigned char)(height >> 16), (unsigned char)(height >> 8), (unsigned char)height,
+		8, 2, 0, 0, 0
+	};
+	chunk(stream, "IHDR", header, 13, ok);
+	chunk(stream, "IDAT", &compressed[0], compressed.size(), ok);
+	chunk(stream, "IEND", 0, 0, ok);
+
+	if (fclose(stream) != 0) ok = false;
+	return ok;
+}
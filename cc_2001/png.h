@@ -0,0 +1,10 @@
+#ifndef PNG_H
+#define PNG_H
+
+// write width*height RGB pixels (top row first) as an 8 bit .png,
+// false if it cannot be written. no library needed - the deflate is a
+// small LZ77 with the fixed Huffman codes, good enough for pictures with
+// a lot of black around the balloons.
+bool write_png(const char *filename, const unsigned char *rgb, int width, int height);
+
+#endif
@@ -0,0 +1,612 @@
+#include "raster.h"
+#include "threadpool.h"
+#include "stats.h"
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+// the image is rasterized in squares of TILE x TILE pixels
+#define TILE 64
+
+// triangles of the input per chunk of the geometry pass
+#define CHUNK 4096
+
+// subpixel steps of the triangle setup
+#define SUBPIXEL 16
+
+// clipped against a band this many times the view around the screen,
+// so the fixed point coordinates stay small
+#define GUARD 4.0
+
+// a corner lit and transformed, before the division by w
+struct ClipVertex
+{
+	double x, y, z, w;
+	float r, g, b;
+};
+
+// a corner on the screen - window coordinates (y up), depth 0..1 and 1/w
+struct ScreenVertex
+{
+	float x, y, z, q;
+	float r, g, b;
+};
+
+enum { POINTS = 1, LINES = 2, TRIANGLES = 3 };
+
+struct Primitive
+{
+	int type;
+	ScreenVertex v[3];
+
+	// pixels it may touch
+	int x0, y0, x1, y1;
+};
+
+// what one chunk of the input became, with the primitives sorted into tiles
+struct Chunk
+{
+	std::vector<Primitive> primitives;
+	std::vector<std::vector<int> > bins;
+};
+
+// everything the passes share
+struct Frame
+{
+	int width, height;
+	int tiles_x, tiles_y;
+
+	const double *projection, *modelview;
+
+	unsigned char *image;
+	float *depth;
+};
+
+
+// ***********************************************************
+//							matrices
+// ***********************************************************
+static void identity(double *m)
+{
+	memset(m, 0, 16*sizeof(double));
+	m[0] = m[5] = m[10] = m[15] = 1;
+}
+
+// m = m * n
+static void multiply(double *m, const double *n)
+{
+	double r[16];
+	for (int c = 0; c < 4; c++)
+		for (int row = 0; row < 4; row++)
+		{
+			double s = 0;
+			for (int k = 0; k < 4; k++) s += m[k*4 + row]*n[c*4 + k];
+			r[c*4 + row] = s;
+		}
+	memcpy(m, r, sizeof(r));
+}
+
+// glRotate
+static void rotate(double *m, double angle, double x, double y, double z)
+{
+	double a = angle*3.14159265358979323846/180;
+	double c = cos(a), s = sin(a);
+	double r[16];
+
+	identity(r);
+	r[0] = x*x*(1-c) + c;	r[4] = x*y*(1-c) - z*s;	r[8] = x*z*(1-c) + y*s;
+	r[1] = y*x*(1-c) + z*s;	r[5] = y*y*(1-c) + c;	r[9] = y*z*(1-c) - x*s;
+	r[2] = x*z*(1-c) - y*s;	r[6] = y*z*(1-c) + x*s;	r[10] = z*z*(1-c) + c;
+	multiply(m, r);
+}
+
+
+// ***********************************************************
+//							geometry
+// ***********************************************************
+
+// position into clip space, the color lit like the viewer does it:
+// light 0 from the eye, 0.2 ambient, normals as they are (no GL_NORMALIZE)
+static void transform(const Frame& f, const Point& P, ClipVertex& out)
+{
+	const double *m = f.modelview, *p = f.projection;
+
+	double ex = m[0]*P.x + m[4]*P.y + m[8]*P.z + m[12];
+	double ey = m[1]*P.x + m[5]*P.y + m[9]*P.z + m[13];
+	double ez = m[2]*P.x + m[6]*P.y + m[10]*P.z + m[14];
+	double ew = m[3]*P.x + m[7]*P.y + m[11]*P.z + m[15];
+
+	out.x = p[0]*ex + p[4]*ey + p[8]*ez + p[12]*ew;
+	out.y = p[1]*ex + p[5]*ey + p[9]*ez + p[13]*ew;
+	out.z = p[2]*ex + p[6]*ey + p[10]*ez + p[14]*ew;
+	out.w = p[3]*ex + p[7]*ey + p[11]*ez + p[15]*ew;
+
+	// only the z of the normal faces the light
+	double nz = m[2]*P.nx + m[6]*P.ny + m[10]*P.nz;
+	double light = 0.2 + (nz > 0 ? nz : 0);
+
+	double r = P.R*light, g = P.G*light, b = P.B*light;
+	out.r = (float)(r > 1 ? 1 : r);
+	out.g = (float)(g > 1 ? 1 : g);
+	out.b = (float)(b > 1 ? 1 : b);
+}
+
+// distance to the planes of the clip volume (inside >= 0)
+static double plane(const ClipVertex& v, int k)
+{
+	switch (k)
+	{
+	case 0: return v.z + v.w;			// near
+	case 1: return v.w - v.z;			// far
+	case 2: return GUARD*v.w + v.x;
+	case 3: return GUARD*v.w - v.x;
+	case 4: return GUARD*v.w + v.y;
+	default: return GUARD*v.w - v.y;
+	}
+}
+
+static ClipVertex between(const ClipVertex& a, const ClipVertex& b, double t)
+{
+	ClipVertex v;
+	v.x = a.x + t*(b.x - a.x);
+	v.y = a.y + t*(b.y - a.y);
+	v.z = a.z + t*(b.z - a.z);
+	v.w = a.w + t*(b.w - a.w);
+	v.r = (float)(a.r + t*(b.r - a.r));
+	v.g = (float)(a.g + t*(b.g - a.g));
+	v.b = (float)(a.b + t*(b.b - a.b));
+	return v;
+}
+
+// cut the polygon (or line, n = 2) at the planes it crosses, returns the new n.
+// every plane adds at most one corner - 9 for a triangle
+static int clip(ClipVertex *v, int n, ClipVertex *scratch)
+{
+	for (int k = 0; k < 6; k++)
+	{
+		int out = 0;
+		double d[12];
+		int i;
+
+		for (i = 0; i < n; i++)
+		{
+			d[i] = plane(v[i], k);
+			if (d[i] < 0) out++;
+		}
+		if (!out) continue;
+		if (out == n) return 0;
+
+		int m = 0;
+		if (n == 2)
+		{
+			// a line keeps its inside end
+			int in = d[0] >= 0 ? 0 : 1;
+			scratch[m++] = v[in];
+			scratch[m++] = between(v[in], v[1 - in], d[in]/(d[in] - d[1 - in]));
+			if (in == 1)
+			{
+				ClipVertex t = scratch[0];
+				scratch[0] = scratch[1];
+				scratch[1] = t;
+			}
+		}
+		else
+		{
+			for (i = 0; i < n; i++)
+			{
+				int j = (i + 1) % n;
+				if (d[i] >= 0) scratch[m++] = v[i];
+				if ((d[i] >= 0) != (d[j] >= 0))
+					scratch[m++] = between(v[i], v[j], d[i]/(d[i] - d[j]));
+			}
+		}
+
+		memcpy(v, scratch, m*sizeof(ClipVertex));
+		n = m;
+	}
+	return n;
+}
+
+static void to_screen(const Frame& f, const ClipVertex& c, ScreenVertex& s)
+{
+	double q = 1/c.w;
+	s.x = (float)((c.x*q*0.5 + 0.5)*f.width);
+	s.y = (float)((c.y*q*0.5 + 0.5)*f.height);
+	s.z = (float)(c.z*q*0.5 + 0.5);
+	s.q = (float)q;
+	s.r = c.r; s.g = c.g; s.b = c.b;
+}
+
+static int clamp(int v, int low, int high)
+{
+	return v < low ? low : (v > high ? high : v);
+}
+
+// the pixels a primitive may cover, false if none of the screen
+static bool bounding(const Frame& f, Primitive& p, int n)
+{
+	float x0 = p.v[0].x, x1 = x0, y0 = p.v[0].y, y1 = y0;
+	for (int i = 1; i < n; i++)
+	{
+		if (p.v[i].x < x0) x0 = p.v[i].x;
+		if (p.v[i].x > x1) x1 = p.v[i].x;
+		if (p.v[i].y < y0) y0 = p.v[i].y;
+		if (p.v[i].y > y1) y1 = p.v[i].y;
+	}
+
+	p.x0 = (int)floor(x0) - 1; p.x1 = (int)floor(x1) + 1;
+	p.y0 = (int)floor(y0) - 1; p.y1 = (int)floor(y1) + 1;
+	if (p.x1 < 0 || p.y1 < 0 || p.x0 >= f.width || p.y0 >= f.height) return false;
+
+	p.x0 = clamp(p.x0, 0, f.width - 1); p.x1 = clamp(p.x1, 0, f.width - 1);
+	p.y0 = clamp(p.y0, 0, f.height - 1); p.y1 = clamp(p.y1, 0, f.height - 1);
+	return true;
+}
+
+static void emit(const Frame& f, Chunk& chunk, int type, const ClipVertex *v)
+{
+	Primitive p;
+	p.type = type;
+	for (int i = 0; i < type; i++) to_screen(f, v[i], p.v[i]);
+	if (!bounding(f, p, type)) return;
+
+	int index = (int)chunk.primitives.size();
+	chunk.primitives.push_back(p);
+
+	for (int ty = p.y0 / TILE; ty <= p.y1 / TILE; ty++)
+		for (int tx = p.x0 / TILE; tx <= p.x1 / TILE; tx++)
+			chunk.bins[ty*f.tiles_x + tx].push_back(index);
+}
+
+// triangles [first, last) of a balloon drawn in style
+static void geometry(const Frame& f, const Balloon& b, int style, int first, int last, Chunk& chunk)
+{
+	ClipVertex v[3], polygon[12], scratch[12];
+
+	for (int t = first; t < last; t++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			Point P;
+			b.corner(t, c, P);
+			transform(f, P, v[c]);
+		}
+
+		if (style == POINTS)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				if (plane(v[c], 0) < 0 || plane(v[c], 1) < 0) continue;
+				if (plane(v[c], 2) < 0 || plane(v[c], 3) < 0 || plane(v[c], 4) < 0 || plane(v[c], 5) < 0) continue;
+				emit(f, chunk, POINTS, v + c);
+			}
+		}
+		else if (style == LINES)
+		{
+			// A-B, A-C, B-C like the viewer
+			static const int ends[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+			for (int e = 0; e < 3; e++)
+			{
+				polygon[0] = v[ends[e][0]];
+				polygon[1] = v[ends[e][1]];
+				if (clip(polygon, 2, scratch) == 2) emit(f, chunk, LINES, polygon);
+			}
+		}
+		else
+		{
+			polygon[0] = v[0]; polygon[1] = v[1]; polygon[2] = v[2];
+			int n = clip(polygon, 3, scratch);
+
+			// a fan of what is left
+			for (int i = 1; i + 1 < n; i++)
+			{
+				ClipVertex tri[3] = { polygon[0], polygon[i], polygon[i + 1] };
+				emit(f, chunk, TRIANGLES, tri);
+			}
+		}
+	}
+}
+
+
+// ***********************************************************
+//							rasterization
+// ***********************************************************
+static inline unsigned char byte(float c)
+{
+	return (unsigned char)(c*255 + 0.5f);
+}
+
+static inline void fragment(const Frame& f, int x, int y, float z, float r, float g, float b)
+{
+	size_t i = (size_t)y*f.width + x;
+	if (!(z <= f.depth[i])) return;
+	f.depth[i] = z;
+
+	// the image starts at the top
+	unsigned char *p = f.image + 3*((size_t)(f.height - 1 - y)*f.width + x);
+	p[0] = byte(r); p[1] = byte(g); p[2] = byte(b);
+}
+
+static void point(const Frame& f, const Primitive& p, int x0, int y0, int x1, int y1)
+{
+	const ScreenVertex& v = p.v[0];
+	int x = (int)floor(v.x), y = (int)floor(v.y);
+	if (x < x0 || x > x1 || y < y0 || y > y1) return;
+	if (v.z < 0 || v.z > 1) return;
+
+	fragment(f, x, y, v.z, v.r, v.g, v.b);
+}
+
+// one pixel per column (or row) along the longer axis
+static void line(const Frame& f, const Primitive& p, int x0, int y0, int x1, int y1)
+{
+	const ScreenVertex& a = p.v[0];
+	const ScreenVertex& b = p.v[1];
+	float dx = b.x - a.x, dy = b.y - a.y;
+	bool along_x = fabsf(dx) >= fabsf(dy);
+
+	float from = along_x ? a.x : a.y, to = along_x ? b.x : b.y;
+	float length = to - from;
+	if (length == 0) return;
+
+	int first = (int)ceilf((from < to ? from : to) - 0.5f);
+	int last = (int)ceilf((from < to ? to : from) - 0.5f) - 1;
+	int low = along_x ? x0 : y0, high = along_x ? x1 : y1;
+	if (first < low) first = low;
+	if (last > high) last = high;
+
+	for (int i = first; i <= last; i++)
+	{
+		float t = (i + 0.5f - from)/length;
+		if (t < 0) t = 0;
+		if (t > 1) t = 1;
+
+		int x, y;
+		if (along_x)
+		{
+			x = i;
+			y = (int)floorf(a.y + t*dy);
+			if (y < y0 || y > y1) continue;
+		}
+		else
+		{
+			y = i;
+			x = (int)floorf(a.x + t*dx);
+			if (x < x0 || x > x1) continue;
+		}
+
+		// colors perspective correct, depth linear on the screen
+		float z = a.z + t*(b.z - a.z);
+		float qa = (1 - t)*a.q, qb = t*b.q;
+		float s = 1/(qa + qb);
+		fragment(f, x, y, z, (qa*a.r + qb*b.r)*s, (qa*a.g + qb*b.g)*s, (qa*a.b + qb*b.b)*s);
+	}
+}
+
+// an attribute as a plane over the screen, around the first corner
+struct Gradient
+{
+	double x, y;
+	double dx, dy, value;
+
+	double at(double px, double py) const { return value + dx*(px - x) + dy*(py - y); }
+};
+
+static bool gradient(const ScreenVertex *v, double a0, double a1, double a2, Gradient& g)
+{
+	// solved on the three corners
+	double x1 = v[1].x - v[0].x, y1 = v[1].y - v[0].y;
+	double x2 = v[2].x - v[0].x, y2 = v[2].y - v[0].y;
+	double d1 = a1 - a0, d2 = a2 - a0;
+	double det = x1*y2 - x2*y1;
+	if (det == 0) return false;
+
+	g.x = v[0].x;
+	g.y = v[0].y;
+	g.dx = (d1*y2 - d2*y1)/det;
+	g.dy = (x1*d2 - x2*d1)/det;
+	g.value = a0;
+	return true;
+}
+
+static void triangle(const Frame& f, const Primitive& p, int x0, int y0, int x1, int y1)
+{
+	const ScreenVertex *v = p.v;
+
+	// corners in fixed point
+	long long X[3], Y[3];
+	for (int i = 0; i < 3; i++)
+	{
+		X[i] = (long long)floor(v[i].x*SUBPIXEL + 0.5);
+		Y[i] = (long long)floor(v[i].y*SUBPIXEL + 0.5);
+	}
+
+	long long area = (X[1] - X[0])*(Y[2] - Y[0]) - (X[2] - X[0])*(Y[1] - Y[0]);
+	if (area == 0) return;
+
+	// counterclockwise from here on - both sides are drawn
+	int order[3] = { 0, 1, 2 };
+	if (area < 0)
+	{
+		order[1] = 2;
+		order[2] = 1;
+	}
+
+	// edge k goes from corner order[k] to order[k+1], the inside is on its left
+	long long A[3], B[3], C[3];
+	for (int k = 0; k < 3; k++)
+	{
+		int a = order[k], b = order[(k + 1) % 3];
+		long long ex = X[b] - X[a], ey = Y[b] - Y[a];
+
+		A[k] = -ey;
+		B[k] = ex;
+		C[k] = ey*X[a] - ex*Y[a];
+
+		// pixels right on an edge belong to its triangle only if it is
+		// a top or a left edge
+		bool top_left = ey < 0 || (ey == 0 && ex < 0);
+		if (!top_left) C[k]--;
+	}
+
+	// depth linear on the screen, the colors perspective correct
+	Gradient z, q, r, g, b;
+	if (!gradient(v, v[0].z, v[1].z, v[2].z, z)) return;
+	gradient(v, v[0].q, v[1].q, v[2].q, q);
+	gradient(v, v[0].r*v[0].q, v[1].r*v[1].q, v[2].r*v[2].q, r);
+	gradient(v, v[0].g*v[0].q, v[1].g*v[1].q, v[2].g*v[2].q, g);
+	gradient(v, v[0].b*v[0].q, v[1].b*v[1].q, v[2].b*v[2].q, b);
+
+	if (p.x0 > x0) x0 = p.x0;
+	if (p.x1 < x1) x1 = p.x1;
+	if (p.y0 > y0) y0 = p.y0;
+	if (p.y1 < y1) y1 = p.y1;
+
+	for (int y = y0; y <= y1; y++)
+	{
+		long long sy = (long long)y*SUBPIXEL + SUBPIXEL/2;
+		long long sx = (long long)x0*SUBPIXEL + SUBPIXEL/2;
+		long long e0 = A[0]*sx + B[0]*sy + C[0];
+		long long e1 = A[1]*sx + B[1]*sy + C[1];
+		long long e2 = A[2]*sx + B[2]*sy + C[2];
+		double cy = y + 0.5;
+
+		for (int x = x0; x <= x1; x++, e0 += A[0]*SUBPIXEL, e1 += A[1]*SUBPIXEL, e2 += A[2]*SUBPIXEL)
+		{
+			if ((e0 | e1 | e2) < 0) continue;
+
+			double cx = x + 0.5;
+			double depth = z.at(cx, cy);
+			if (depth < 0 || depth > 1) continue;
+
+			double s = 1/q.at(cx, cy);
+			fragment(f, x, y, (float)depth,
+					 (float)(r.at(cx, cy)*s), (float)(g.at(cx, cy)*s), (float)(b.at(cx, cy)*s));
+		}
+	}
+}
+
+
+// ***********************************************************
+//							Rasterizer
+// ***********************************************************
+Rasterizer::Rasterizer(int width, int height)
+{
+	w = width;
+	h = height;
+	image = new unsigned char[3*(size_t)w*h];
+	depth = new float[(size_t)w*h];
+	primitives = 0;
+
+	view(0);
+}
+
+Rasterizer::~Rasterizer()
+{
+	delete[] image;
+	delete[] depth;
+}
+
+void Rasterizer::view(float rot)
+{
+	// gluPerspective(45, width/height, 0.1, 100)
+	double near_plane = 0.1, far_plane = 100;
+	double top = near_plane*tan(45.0/2*3.14159265358979323846/180);
+	double aspect = (double)w/h;
+
+	memset(projection, 0, sizeof(projection));
+	projection[0] = near_plane/(top*aspect);
+	projection[5] = near_plane/top;
+	projection[10] = -(far_plane + near_plane)/(far_plane - near_plane);
+	projection[11] = -1;
+	projection[14] = -2*far_plane*near_plane/(far_plane - near_plane);
+
+	// DrawGLScene: 10 units into the screen, turned around x and y
+	identity(modelview);
+	modelview[14] = -10;
+	rotate(modelview, rot, 1, 0, 0);
+	rotate(modelview, rot*1.5f, 0, 1, 0);
+}
+
+void Rasterizer::draw(const Balloon *balloons, int count, int object_style, int around_style)
+{
+	STATS(PhaseTimer timer(PHASE_RENDER);)
+
+	memset(image, 0, 3*(size_t)w*h);
+	for (size_t i = 0; i < (size_t)w*h; i++) depth[i] = 1;
+	primitives = 0;
+
+	Frame f;
+	f.width = w;
+	f.height = h;
+	f.tiles_x = (w + TILE - 1)/TILE;
+	f.tiles_y = (h + TILE - 1)/TILE;
+	f.projection = projection;
+	f.modelview = modelview;
+	f.image = image;
+	f.depth = depth;
+
+	// the input cut into chunks, in drawing order
+	struct Work
+	{
+		int balloon, first, last;
+	};
+	std::vector<Work> work;
+
+	for (int k = 0; k < count; k++)
+	{
+		const Balloon& b = balloons[k];
+		int style = k == 0 ? object_style : around_style;
+		if (style < POINTS || style > TRIANGLES) continue;
+		if (k > 0 && !b.setup_complete) continue;
+
+		for (int first = 0; first < b.count; first += CHUNK)
+		{
+			Work item = { k, first, first + CHUNK < b.count ? first + CHUNK : b.count };
+			work.push_back(item);
+		}
+	}
+
+	int tiles = f.tiles_x*f.tiles_y;
+	std::vector<Chunk> chunks(work.size());
+	ThreadPool& pool = thread_pool();
+
+	// light, transform, clip and sort into tiles
+	pool.parallel_for((int)work.size(), 1, [&](int first, int last)
+	{
+		for (int i = first; i < last; i++)
+		{
+			const Work& item = work[i];
+			chunks[i].bins.resize(tiles);
+			geometry(f, balloons[item.balloon], item.balloon == 0 ? object_style : around_style,
+					 item.first, item.last, chunks[i]);
+		}
+	});
+
+	// every tile on its own, the chunks in drawing order
+	pool.parallel_for(tiles, 1, [&](int first, int last)
+	{
+		for (int t = first; t < last; t++)
+		{
+			int x0 = (t % f.tiles_x)*TILE, y0 = (t / f.tiles_x)*TILE;
+			int x1 = x0 + TILE - 1, y1 = y0 + TILE - 1;
+			if (x1 >= w) x1 = w - 1;
+			if (y1 >= h) y1 = h - 1;
+
+			for (size_t c = 0; c < chunks.size(); c++)
+			{
+				const std::vector<int>& bin = chunks[c].bins[t];
+				for (size_t n = 0; n < bin.size(); n++)
+				{
+					const Primitive& p = chunks[c].primitives[bin[n]];
+					if (p.type == TRIANGLES) triangle(f, p, x0, y0, x1, y1);
+					else if (p.type == LINES) line(f, p, x0, y0, x1, y1);
+					else point(f, p, x0, y0, x1, y1);
+				}
+			}
+		}
+	});
+
+	for (size_t c = 0; c < chunks.size(); c++)
+		primitives += chunks[c].primitives.size();
+}
@@ -0,0 +1,43 @@
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "balloon.h"
+
+// software rendering of the balloons, for pictures without a graphics card.
+// draws what the viewer draws - the same camera, light 0 on the colors,
+// Gouraud shading of the smooth triangles and one normal for the flat
+// ones, points, lines or triangles - into an RGB image with a depth
+// buffer. the image is cut into tiles which the threads rasterize on
+// their own, so the picture is the same for any number of threads.
+class Rasterizer
+{
+public:
+	Rasterizer(int width, int height);
+	~Rasterizer();
+
+	// the viewer's camera after rot frames (0 = the first one)
+	void view(float rot);
+
+	// clear the image and draw the balloons, the first one is the object.
+	// styles as in the .bal file: 0 nothing, 1 points, 2 lines, 3 polygons
+	void draw(const Balloon *balloons, int count, int object_style, int around_style);
+
+	// width*height RGB pixels, top row first
+	const unsigned char *pixels() const { return image; }
+	int width() const { return w; }
+	int height() const { return h; }
+
+	// primitives drawn by the last draw (after clipping)
+	long long primitives;
+
+private:
+	int w, h;
+	unsigned char *image;
+	float *depth;
+
+	// column-major like OpenGL
+	double projection[16];
+	double modelview[16];
+};
+
+#endif
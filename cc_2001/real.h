@@ -0,0 +1,28 @@
+#ifndef REAL_H
+#define REAL_H
+
+// the numbers the meshes are made of. compile with -DBALLOON_FLOAT=1 to
+// keep vertices, normals, colours and boxes in float - half the memory
+// and twice the vertices per instruction in the deform kernel. the
+// balloons themselves (centers, radii, pressures) stay double, so does
+// the arithmetic of setup. the default double build is the one to check
+// the accuracy against.
+#ifndef BALLOON_FLOAT
+#define BALLOON_FLOAT 0
+#endif
+
+#if BALLOON_FLOAT
+typedef float real;
+#else
+typedef double real;
+#endif
+
+// relative slack of the tests which skip vertices before the kernel -
+// whatever the rounding, a vertex the kernel would move is never skipped
+#if BALLOON_FLOAT
+#define REAL_SLACK 1e-5
+#else
+#define REAL_SLACK 1e-9
+#endif
+
+#endif
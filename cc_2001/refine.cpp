@@ -0,0 +1,261 @@
+#include "refine.h"
+#include "contact.h"
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+// as in the tessellation - the lattice ends at the same angles
+#define PI 3.1415
+
+// full density this many rows (columns) beyond the rim
+#define MARGIN 1.5
+
+
+// ***********************************************************
+//							knots
+// ***********************************************************
+struct Interval
+{
+	double from, to;
+};
+
+// the angles of one lattice
+struct Lattice
+{
+	std::vector<double> rows, cols;
+};
+
+// sorted, overlapping ones joined
+static void merge(std::vector<Interval>& list)
+{
+	std::sort(list.begin(), list.end(), [](const Interval& p, const Interval& q)
+	{
+		return p.from < q.from;
+	});
+
+	size_t kept = 0;
+	for (size_t i = 0; i < list.size(); i++)
+	{
+		if (kept > 0 && list[i].from <= list[kept - 1].to)
+		{
+			if (list[i].to > list[kept - 1].to) list[kept - 1].to = list[i].to;
+		}
+		else list[kept++] = list[i];
+	}
+	list.resize(kept);
+}
+
+// angles 0 .. length, steps of about fine inside the intervals and coarse
+// outside, at least minimum steps. the steps change at once at the ends
+// of an interval - the deformation only needs the rim to be fine.
+static void knots(std::vector<Interval>& fine_parts, double length, double fine, double coarse,
+				  int minimum, std::vector<double>& out)
+{
+	merge(fine_parts);
+
+	// pieces of constant density covering 0 .. length
+	std::vector<Interval> piece;
+	std::vector<double> density;
+	double at = 0;
+
+	for (size_t i = 0; i < fine_parts.size(); i++)
+	{
+		if (fine_parts[i].from > at)
+		{
+			Interval p = { at, fine_parts[i].from };
+			piece.push_back(p);
+			density.push_back(1/coarse);
+		}
+		piece.push_back(fine_parts[i]);
+		density.push_back(1/fine);
+		at = fine_parts[i].to;
+	}
+	if (at < length)
+	{
+		Interval p = { at, length };
+		piece.push_back(p);
+		density.push_back(1/coarse);
+	}
+
+	double total = 0;
+	for (size_t i = 0; i < piece.size(); i++)
+		total += (piece[i].to - piece[i].from)*density[i];
+
+	int steps = (int)ceil(total - 1e-9);
+	if (steps < minimum) steps = minimum;
+
+	// step k lands where the integral of the density reaches k*total/steps
+	out.resize(steps + 1);
+	out[0] = 0;
+	size_t p = 0;
+	double below = 0;
+
+	for (int k = 1; k < steps; k++)
+	{
+		double wanted = total*k/steps;
+		while (p + 1 < piece.size() && below + (piece[p].to - piece[p].from)*density[p] < wanted)
+		{
+			below += (piece[p].to - piece[p].from)*density[p];
+			p++;
+		}
+		out[k] = piece[p].from + (wanted - below)/density[p];
+	}
+	out[steps] = length;
+}
+
+
+// ***********************************************************
+//							rims
+// ***********************************************************
+
+// the rows and columns of a where the sphere of b cuts it (or all of
+// them when b swallows a)
+static void rim(const Balloon& a, const Balloon& b, double row_step, double col_step,
+				std::vector<Interval>& rows, std::vector<Interval>& cols)
+{
+	if (a.pressure + b.pressure == 0) return;
+
+	double dx = b.x - a.x;
+	double dy = b.y - a.y;
+	double dz = b.z - a.z;
+	double dist = sqrt(dx*dx + dy*dy + dz*dz);
+
+	// apart, or b inside a - nothing moves
+	if (dist >= a.radius + b.radius || dist + b.radius <= a.radius) return;
+
+	// a inside b - all of it is pressed
+	if (dist == 0 || dist + a.radius <= b.radius)
+	{
+		Interval all_rows = { 0, PI }, all_cols = { 0, 2*PI };
+		rows.push_back(all_rows);
+		cols.push_back(all_cols);
+		return;
+	}
+
+	// angle between the direction to b and the rim, seen from the center of a
+	double c = (a.radius*a.radius + dist*dist - b.radius*b.radius)/(2*a.radius*dist);
+	double spread = acos(c < -1 ? -1 : (c > 1 ? 1 : c)) + MARGIN*row_step;
+
+	// the direction in lattice angles - y = cos(row), x : z = sin : cos(col)
+	double up = dy/dist;
+	double row = acos(up < -1 ? -1 : (up > 1 ? 1 : up));
+	double col = atan2(dx, dz);
+	if (col < 0) col += 2*PI;
+
+	Interval r = { row - spread < 0 ? 0 : row - spread, row + spread > PI ? PI : row + spread };
+	rows.push_back(r);
+
+	// around a pole every column crosses the rim
+	double s = sin(row);
+	if (row - spread <= 0 || row + spread >= PI || sin(spread) >= s)
+	{
+		Interval all = { 0, 2*PI };
+		cols.push_back(all);
+		return;
+	}
+
+	double width = asin(sin(spread)/s) + MARGIN*col_step;
+	if (width >= PI)
+	{
+		Interval all = { 0, 2*PI };
+		cols.push_back(all);
+		return;
+	}
+
+	// split where the lattice closes
+	Interval w = { col - width, col + width };
+	if (w.from < 0)
+	{
+		Interval end = { w.from + 2*PI, 2*PI };
+		cols.push_back(end);
+		w.from = 0;
+	}
+	if (w.to > 2*PI)
+	{
+		Interval start = { 0, w.to - 2*PI };
+		cols.push_back(start);
+		w.to = 2*PI;
+	}
+	cols.push_back(w);
+}
+
+
+// ***********************************************************
+//							setup
+// ***********************************************************
+void setup_adaptive(Balloon *balloons, int n, int segments, int pies, int coarse, bool everything,
+					bool object_color, bool around_color, Arena& arena)
+{
+	int coarse_segments = segments/coarse, coarse_pies = pies/coarse;
+	if (coarse_segments < 4) coarse_segments = 4;
+	if (coarse_pies < 4) coarse_pies = 4;
+	if (coarse_segments > segments) coarse_segments = segments;
+	if (coarse_pies > pies) coarse_pies = pies;
+
+	std::vector<Contact> contacts;
+	find_contacts(balloons, n, contacts);
+
+	// the balloons touching each one
+	std::vector<std::vector<int> > touching(n);
+	size_t k;
+	int i;
+
+	for (k = 0; k < contacts.size(); k++)
+	{
+		touching[contacts[k].a].push_back(contacts[k].b);
+		touching[contacts[k].b].push_back(contacts[k].a);
+	}
+
+	// the lattices first, the arena needs their sizes
+	std::vector<Lattice> lattice(n);
+	size_t bytes = 0;
+
+	for (i = 0; i < n; i++)
+	{
+		std::vector<Interval> rows, cols;
+		if (i == 0 || everything)
+		{
+			for (k = 0; k < touching[i].size(); k++)
+				rim(balloons[i], balloons[touching[i][k]], PI/segments, 2*PI/pies, rows, cols);
+		}
+
+		if (!rows.empty())
+		{
+			knots(rows, PI, PI/segments, PI/coarse_segments, coarse_segments, lattice[i].rows);
+			knots(cols, 2*PI, 2*PI/pies, 2*PI/coarse_pies, coarse_pies, lattice[i].cols);
+			bytes += Balloon::storage_size((int)lattice[i].rows.size() - 1, (int)lattice[i].cols.size() - 1);
+		}
+		else bytes += Balloon::storage_size(coarse_segments, coarse_pies);
+	}
+
+	arena.reserve(bytes);
+
+	std::vector<double> ring, col_sin, col_cos;
+
+	for (i = 0; i < n; i++)
+	{
+		bool color = i == 0 ? object_color : around_color;
+		const Lattice& L = lattice[i];
+
+		// touches nothing - the plain coarse sphere, shared with the others
+		if (L.rows.empty())
+		{
+			balloons[i].setup(coarse_segments, coarse_pies, color, &arena);
+			continue;
+		}
+
+		ring.resize(L.rows.size());
+		col_sin.resize(L.cols.size());
+		col_cos.resize(L.cols.size());
+		for (k = 0; k < L.rows.size(); k++)
+			ring[k] = cos(L.rows[k]);
+		for (k = 0; k < L.cols.size(); k++)
+		{
+			col_sin[k] = sin(L.cols[k]);
+			col_cos[k] = cos(L.cols[k]);
+		}
+
+		balloons[i].setup_refined((int)L.rows.size() - 1, (int)L.cols.size() - 1, color,
+								  &ring[0], &col_sin[0], &col_cos[0], &arena);
+	}
+}
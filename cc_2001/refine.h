@@ -0,0 +1,17 @@
+#ifndef REFINE_H
+#define REFINE_H
+
+#include "balloon.h"
+#include "arena.h"
+
+// adaptive setup: every balloon starts from a coarse lattice of
+// segments/coarse x pies/coarse and gets the full density of segments x
+// pies only in the rows and columns crossing the spheres of the balloons
+// it touches (with a little margin around the rim). balloons touching
+// nothing stay coarse and evenly spaced. the lattice keeps its rows and
+// columns, so deform, the bounds and the exporters work on it unchanged.
+// only the object is refined unless everything will be deformed.
+void setup_adaptive(Balloon *balloons, int n, int segments, int pies, int coarse, bool everything,
+					bool object_color, bool around_color, Arena& arena);
+
+#endif
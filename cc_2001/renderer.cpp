@@ -0,0 +1,812 @@
+#include "renderer.h"
+#include "tessellation.h"
+#include "threadpool.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+// what gl.h of OpenGL 1.1 does not know
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER				0x8892
+#define GL_ELEMENT_ARRAY_BUFFER		0x8893
+#define GL_STATIC_DRAW				0x88E4
+#define GL_STREAM_DRAW				0x88E0
+#endif
+#ifndef GL_VERTEX_SHADER
+#define GL_VERTEX_SHADER			0x8B31
+#define GL_COMPILE_STATUS			0x8B81
+#define GL_LINK_STATUS				0x8B82
+#endif
+
+// 10 floats per corner: position, normal, color
+#define CORNER_FLOATS 10
+#define CORNER_BYTES (CORNER_FLOATS*sizeof(float))
+
+// attribute with the place of an instance (aliases nothing on any driver)
+#define PLACEMENT_ATTRIBUTE 6
+
+
+// ***********************************************************
+//							functions
+// ***********************************************************
+struct RendererGL
+{
+	int major, minor;
+	bool buffers, instancing;
+
+	// buffer objects (1.5)
+	void (APIENTRY *GenBuffers)(GLsizei, GLuint *);
+	void (APIENTRY *DeleteBuffers)(GLsizei, const GLuint *);
+	void (APIENTRY *BindBuffer)(GLenum, GLuint);
+	void (APIENTRY *BufferData)(GLenum, ptrdiff_t, const void *, GLenum);
+
+	// shaders (2.0)
+	GLuint (APIENTRY *CreateShader)(GLenum);
+	void (APIENTRY *ShaderSource)(GLuint, GLsizei, const char *const *, const GLint *);
+	void (APIENTRY *CompileShader)(GLuint);
+	void (APIENTRY *GetShaderiv)(GLuint, GLenum, GLint *);
+	void (APIENTRY *DeleteShader)(GLuint);
+	GLuint (APIENTRY *CreateProgram)();
+	void (APIENTRY *AttachShader)(GLuint, GLuint);
+	void (APIENTRY *BindAttribLocation)(GLuint, GLuint, const char *);
+	void (APIENTRY *LinkProgram)(GLuint);
+	void (APIENTRY *GetProgramiv)(GLuint, GLenum, GLint *);
+	void (APIENTRY *UseProgram)(GLuint);
+	void (APIENTRY *DeleteProgram)(GLuint);
+	void (APIENTRY *EnableVertexAttribArray)(GLuint);
+	void (APIENTRY *DisableVertexAttribArray)(GLuint);
+	void (APIENTRY *VertexAttribPointer)(GLuint, GLint, GLenum, GLboolean, GLsizei, const void *);
+
+	// instancing (3.1, 3.3)
+	void (APIENTRY *DrawArraysInstanced)(GLenum, GLint, GLsizei, GLsizei);
+	void (APIENTRY *DrawElementsInstanced)(GLenum, GLsizei, GLenum, const void *, GLsizei);
+	void (APIENTRY *VertexAttribDivisor)(GLuint, GLuint);
+};
+
+template <class F> static bool load(GLLoader loader, const char *name, F& f)
+{
+	f = (F)loader(name);
+	return f != 0;
+}
+
+// the unit sphere moved and scaled to one undeformed balloon, lit by
+// light 0 on the color material like the fixed pipeline (the viewer has
+// no specular light, so neither has this)
+static const char *instance_shader =
+	"#version 120\n"
+	"attribute vec4 placement;\n"
+	"void main()\n"
+	"{\n"
+	"	vec3 center = placement.xyz;\n"
+	"	float radius = placement.w;\n"
+	"	vec4 position = vec4(center + radius*gl_Vertex.xyz, 1.0);\n"
+	// setup divides the vertex by the radius, center and all - and
+	// nothing normalizes it afterwards
+	"	vec3 normal = gl_NormalMatrix*(gl_Normal + center/radius);\n"
+	"	vec3 light = normalize(gl_LightSource[0].position.xyz);\n"
+	"	float diffuse = max(dot(normal, light), 0.0);\n"
+	"	vec3 lit = gl_FrontMaterial.emission.rgb + gl_Color.rgb*(gl_LightModel.ambient.rgb\n"
+	"		+ gl_LightSource[0].ambient.rgb + diffuse*gl_LightSource[0].diffuse.rgb);\n"
+	"	gl_FrontColor = vec4(clamp(lit, 0.0, 1.0), gl_Color.a);\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix*position;\n"
+	"}\n";
+
+static GLuint build_program(RendererGL *gl)
+{
+	GLuint shader = gl->CreateShader(GL_VERTEX_SHADER);
+	gl->ShaderSource(shader, 1, &instance_shader, 0);
+	gl->CompileShader(shader);
+
+	GLint ok = 0;
+	gl->GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok)
+	{
+		gl->DeleteShader(shader);
+		return 0;
+	}
+
+	GLuint program = gl->CreateProgram();
+	gl->AttachShader(program, shader);
+	gl->BindAttribLocation(program, PLACEMENT_ATTRIBUTE, "placement");
+	gl->LinkProgram(program);
+	gl->DeleteShader(shader);
+
+	gl->GetProgramiv(program, GL_LINK_STATUS, &ok);
+	if (!ok)
+	{
+		gl->DeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+
+// ***********************************************************
+//							Renderer
+// ***********************************************************
+Renderer::Renderer()
+{
+	gl = new RendererGL;
+	memset(gl, 0, sizeof(RendererGL));
+
+	detail = 4;
+	draw_calls = 0;
+	triangles = 0;
+	instances = 0;
+
+	data = 0;
+	count_data = 0;
+	lines = 0;
+
+	count_balloons = count_levels = 0;
+	first = 0;
+	length = 0;
+	steps = 0;
+	sphere = 0;
+	instanced = 0;
+	chosen = 0;
+	unit_first = 0;
+	unit_length = 0;
+	placement = 0;
+	sorted = 0;
+	level_instances = 0;
+	sorted_dirty = false;
+
+	vertex_buffer = 0;
+	index_buffer = 0;
+	instance_buffer = 0;
+	program = 0;
+}
+
+Renderer::~Renderer()
+{
+	// the context may be gone by now - only the memory
+	gl->buffers = false;
+	drop_meshes();
+	delete gl;
+}
+
+void Renderer::init(GLLoader loader)
+{
+	release();
+	memset(gl, 0, sizeof(RendererGL));
+
+	const char *version = (const char *)glGetString(GL_VERSION);
+	if (!version || sscanf(version, "%d.%d", &gl->major, &gl->minor) != 2)
+		gl->major = gl->minor = 1;
+	int v = 10*gl->major + gl->minor;
+
+	gl->buffers = v >= 15 &&
+		load(loader, "glGenBuffers", gl->GenBuffers) &&
+		load(loader, "glDeleteBuffers", gl->DeleteBuffers) &&
+		load(loader, "glBindBuffer", gl->BindBuffer) &&
+		load(loader, "glBufferData", gl->BufferData);
+
+	gl->instancing = gl->buffers && v >= 33 &&
+		load(loader, "glCreateShader", gl->CreateShader) &&
+		load(loader, "glShaderSource", gl->ShaderSource) &&
+		load(loader, "glCompileShader", gl->CompileShader) &&
+		load(loader, "glGetShaderiv", gl->GetShaderiv) &&
+		load(loader, "glDeleteShader", gl->DeleteShader) &&
+		load(loader, "glCreateProgram", gl->CreateProgram) &&
+		load(loader, "glAttachShader", gl->AttachShader) &&
+		load(loader, "glBindAttribLocation", gl->BindAttribLocation) &&
+		load(loader, "glLinkProgram", gl->LinkProgram) &&
+		load(loader, "glGetProgramiv", gl->GetProgramiv) &&
+		load(loader, "glUseProgram", gl->UseProgram) &&
+		load(loader, "glDeleteProgram", gl->DeleteProgram) &&
+		load(loader, "glEnableVertexAttribArray", gl->EnableVertexAttribArray) &&
+		load(loader, "glDisableVertexAttribArray", gl->DisableVertexAttribArray) &&
+		load(loader, "glVertexAttribPointer", gl->VertexAttribPointer) &&
+		load(loader, "glDrawArraysInstanced", gl->DrawArraysInstanced) &&
+		load(loader, "glDrawElementsInstanced", gl->DrawElementsInstanced) &&
+		load(loader, "glVertexAttribDivisor", gl->VertexAttribDivisor);
+
+	if (gl->instancing)
+	{
+		program = build_program(gl);
+		if (!program) gl->instancing = false;
+	}
+}
+
+bool Renderer::buffers() const
+{
+	return gl->buffers;
+}
+
+bool Renderer::instancing() const
+{
+	return gl->instancing;
+}
+
+void Renderer::release()
+{
+	drop_meshes();
+
+	if (program) gl->DeleteProgram(program);
+	program = 0;
+}
+
+void Renderer::drop_meshes()
+{
+	if (gl->buffers)
+	{
+		GLuint names[3] = { vertex_buffer, index_buffer, instance_buffer };
+		gl->DeleteBuffers(3, names);
+	}
+	vertex_buffer = index_buffer = instance_buffer = 0;
+
+	delete[] data;
+	delete[] lines;
+	delete[] first;
+	delete[] length;
+	delete[] steps;
+	delete[] sphere;
+	delete[] instanced;
+	delete[] chosen;
+	delete[] unit_first;
+	delete[] unit_length;
+	delete[] placement;
+	delete[] sorted;
+	delete[] level_instances;
+	data = 0;
+	lines = 0;
+	first = length = 0;
+	steps = sphere = 0;
+	instanced = 0;
+	chosen = unit_first = unit_length = 0;
+	placement = sorted = 0;
+	level_instances = 0;
+	count_data = 0;
+
+	count_balloons = count_levels = 0;
+	instances = 0;
+	sorted_dirty = false;
+}
+
+// a balloon around the object which is still its unit sphere
+static bool undeformed(const Balloon& b)
+{
+	if (!b.setup_complete || b.radius <= 0) return false;
+
+	// a refined lattice is not the unit sphere
+	if (b.adaptive) return false;
+
+	// deform turns every triangle it touches flat, and incremental
+	// deformation turns them back once all their corners are home
+	for (int t = 0; t < b.count; t++)
+		if (b.mesh[t].flat) return false;
+	return true;
+}
+
+void Renderer::add_corners(const Balloon *balloons, int first, int last)
+{
+	for (int k = first; k < last; k++)
+	{
+		const Balloon& b = balloons[k];
+		float *out = data + count_data*CORNER_FLOATS;
+
+		thread_pool().parallel_for(b.count, 1024, [&](int from, int to)
+		{
+			for (int t = from; t < to; t++)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					Point P;
+					b.corner(t, c, P);
+
+					float *f = out + (3*t + c)*CORNER_FLOATS;
+					f[0] = (float)P.x; f[1] = (float)P.y; f[2] = (float)P.z;
+					f[3] = (float)P.nx; f[4] = (float)P.ny; f[5] = (float)P.nz;
+					f[6] = (float)P.R; f[7] = (float)P.G; f[8] = (float)P.B; f[9] = (float)P.A;
+				}
+			}
+		});
+
+		count_data += 3*b.count;
+	}
+}
+
+int Renderer::add_unit(int segments, int pies, bool color)
+{
+	const Tessellation& T = tessellation(segments, pies, color);
+	float *out = data + count_data*CORNER_FLOATS;
+	int cols = pies + 1;
+
+	for (int t = 0; t < T.count; t++)
+	{
+		const Triangle& tr = T.mesh[t];
+		int corner[3] = { tr.a, tr.b, tr.c };
+
+		for (int c = 0; c < 3; c++)
+		{
+			// the vertex of setup with radius 1 at the origin
+			int i = corner[c] / cols, j = corner[c] % cols;
+			double y = T.ring[i];
+			double r = sqrt(1 - y*y);
+
+			float *f = out + (3*t + c)*CORNER_FLOATS;
+			f[0] = (float)(r*T.col_sin[j]); f[1] = (float)y; f[2] = (float)(r*T.col_cos[j]);
+			f[3] = f[0]; f[4] = f[1]; f[5] = f[2];
+			f[6] = (float)tr.R; f[7] = (float)tr.G; f[8] = (float)tr.B; f[9] = (float)tr.A;
+		}
+	}
+
+	count_data += 3*T.count;
+	return T.count;
+}
+
+void Renderer::upload(const Balloon *balloons, int count)
+{
+	upload(&balloons, 1, count);
+}
+
+void Renderer::upload(const Balloon *const *levels, int count_levels, int count)
+{
+	// keep the functions and the program
+	drop_meshes();
+
+	if (count < 1 || count_levels < 1) return;
+
+	this->count_balloons = count;
+	this->count_levels = count_levels;
+
+	// the undeformed balloons around the object - on every level with
+	// the lattice of the first of them there - are instances, the others
+	// go into the buffer level by level
+	instanced = new unsigned char[count];
+	int unit = -1;
+	int k, L;
+
+	for (k = 0; k < count; k++)
+	{
+		bool same = k > 0 && gl->instancing;
+		for (L = 0; same && L < count_levels; L++)
+		{
+			const Balloon& b = levels[L][k];
+			if (!undeformed(b)) same = false;
+			else if (unit >= 0)
+			{
+				const Balloon& u = levels[L][unit];
+				same = b.segments == u.segments && b.pies == u.pies && b.color == u.color;
+			}
+		}
+
+		if (same && unit < 0) unit = k;
+		instanced[k] = same;
+		if (same) instances++;
+	}
+
+	size_t meshes = 0, units = 0;
+	int largest_unit = 0;
+
+	for (L = 0; L < count_levels; L++)
+		for (k = 0; k < count; k++)
+			if (!instanced[k] && levels[L][k].setup_complete) meshes += levels[L][k].count;
+
+	if (unit >= 0)
+	{
+		for (L = 0; L < count_levels; L++)
+		{
+			const Balloon& u = levels[L][unit];
+			int n = tessellation(u.segments, u.pies, u.color).count;
+			units += n;
+			if (n > largest_unit) largest_unit = n;
+		}
+	}
+
+	data = new float[3*(meshes + units)*CORNER_FLOATS];
+
+	first = new int[count_levels*count];
+	length = new int[count_levels*count];
+	steps = new float[count_levels*count];
+
+	for (L = 0; L < count_levels; L++)
+	{
+		for (k = 0; k < count; k++)
+		{
+			const Balloon& b = levels[L][k];
+			int i = L*count + k;
+
+			// a row is pi/segments of the way around, a column 2 pi/pies
+			steps[i] = b.segments < b.pies/2.0f ? (float)b.segments : b.pies/2.0f;
+
+			if (instanced[k] || !b.setup_complete)
+			{
+				first[i] = -1;
+				length[i] = 0;
+				continue;
+			}
+
+			first[i] = (int)(count_data/3);
+			length[i] = b.count;
+			add_corners(levels[L], k, k + 1);
+		}
+	}
+
+	unit_first = new int[count_levels];
+	unit_length = new int[count_levels];
+	for (L = 0; L < count_levels; L++)
+	{
+		unit_first[L] = (int)(count_data/3);
+		unit_length[L] = 0;
+		if (unit >= 0)
+		{
+			const Balloon& u = levels[L][unit];
+			unit_length[L] = add_unit(u.segments, u.pies, u.color);
+		}
+	}
+
+	// lines A-B, A-C, B-C of every triangle, enough for either part
+	size_t triangles = meshes;
+	if ((size_t)largest_unit > triangles) triangles = largest_unit;
+
+	lines = new unsigned int[6*triangles];
+	for (size_t t = 0; t < triangles; t++)
+	{
+		unsigned int *l = lines + 6*t;
+		l[0] = (unsigned int)(3*t); l[1] = (unsigned int)(3*t + 1);
+		l[2] = (unsigned int)(3*t); l[3] = (unsigned int)(3*t + 2);
+		l[4] = (unsigned int)(3*t + 1); l[5] = (unsigned int)(3*t + 2);
+	}
+
+	// every balloon starts on level 0
+	sphere = new float[4*count];
+	chosen = new int[count];
+	for (k = 0; k < count; k++)
+	{
+		sphere[4*k] = (float)levels[0][k].x;
+		sphere[4*k + 1] = (float)levels[0][k].y;
+		sphere[4*k + 2] = (float)levels[0][k].z;
+		sphere[4*k + 3] = (float)levels[0][k].radius;
+		chosen[k] = 0;
+	}
+
+	level_instances = new int[count_levels + 1];
+	if (instances)
+	{
+		placement = new float[4*instances];
+		sorted = new float[4*instances];
+		int n = 0;
+		for (k = 1; k < count; k++)
+		{
+			if (!instanced[k]) continue;
+			memcpy(placement + 4*n, sphere + 4*k, 4*sizeof(float));
+			n++;
+		}
+		memcpy(sorted, placement, 4*instances*sizeof(float));
+	}
+
+	if (!gl->buffers) return;
+
+	// into the buffers, the meshes are not needed in memory any more
+	GLuint names[3];
+	gl->GenBuffers(3, names);
+	vertex_buffer = names[0];
+	index_buffer = names[1];
+	instance_buffer = names[2];
+
+	gl->BindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	gl->BufferData(GL_ARRAY_BUFFER, count_data*CORNER_BYTES, data, GL_STATIC_DRAW);
+
+	gl->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	gl->BufferData(GL_ELEMENT_ARRAY_BUFFER, 6*triangles*sizeof(unsigned int), lines, GL_STATIC_DRAW);
+
+	if (instances)
+	{
+		// sorted again when the levels change
+		gl->BindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+		gl->BufferData(GL_ARRAY_BUFFER, 4*instances*sizeof(float), sorted, count_levels > 1 ? GL_STREAM_DRAW : GL_STATIC_DRAW);
+	}
+
+	gl->BindBuffer(GL_ARRAY_BUFFER, 0);
+	gl->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	delete[] data;
+	delete[] lines;
+	data = 0;
+	lines = 0;
+}
+
+void Renderer::choose_levels()
+{
+	if (count_levels < 2) return;
+
+	// pixels per unit at distance 1 - the size of a ball in the middle of
+	// the picture is good enough for this
+	GLdouble modelview[16], projection[16];
+	GLint viewport[4];
+	glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
+	glGetDoublev(GL_PROJECTION_MATRIX, projection);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	double scale = projection[5]*viewport[3]/2;
+	bool perspective = projection[11] != 0;
+
+	for (int k = 0; k < count_balloons; k++)
+	{
+		const float *b = sphere + 4*k;
+		int L = 0;
+
+		double distance = -(modelview[2]*b[0] + modelview[6]*b[1] + modelview[10]*b[2] + modelview[14]);
+		if (!perspective) distance = 1;
+
+		// the coarsest level whose edges stay short enough, level 0 when
+		// the camera is inside the balloon
+		if (distance > b[3])
+		{
+			double pixels = 3.14159265358979323846*b[3]*scale/distance;
+			for (L = count_levels - 1; L > 0; L--)
+				if (pixels/steps[L*count_balloons + k] <= detail) break;
+		}
+
+		if (chosen[k] != L && instanced[k]) sorted_dirty = true;
+		chosen[k] = L;
+	}
+}
+
+void Renderer::bind_corners(size_t first)
+{
+	// offsets into the buffer or addresses in memory
+	const char *base = gl->buffers ? (const char *)0 : (const char *)data;
+	base += first*CORNER_BYTES;
+
+	glVertexPointer(3, GL_FLOAT, CORNER_BYTES, base);
+	glNormalPointer(GL_FLOAT, CORNER_BYTES, base + 3*sizeof(float));
+	glColorPointer(4, GL_FLOAT, CORNER_BYTES, base + 6*sizeof(float));
+}
+
+void Renderer::draw_range(int style, int first_triangle, int triangles)
+{
+	if (triangles <= 0) return;
+
+	switch (style)
+	{
+	case 1:
+		glDrawArrays(GL_POINTS, 3*first_triangle, 3*triangles);
+		break;
+	case 2:
+	{
+		const char *base = gl->buffers ? (const char *)0 : (const char *)lines;
+		glDrawElements(GL_LINES, 6*triangles, GL_UNSIGNED_INT, base + 6*(size_t)first_triangle*sizeof(unsigned int));
+		break;
+	}
+	case 3:
+		glDrawArrays(GL_TRIANGLES, 3*first_triangle, 3*triangles);
+		break;
+	default:
+		// do not draw
+		return;
+	}
+	draw_calls++;
+	this->triangles += triangles;
+}
+
+void Renderer::draw(int object_style, int around_style)
+{
+	draw_calls = 0;
+	triangles = 0;
+	if (!count_data) return;
+
+	choose_levels();
+
+	if (gl->buffers)
+	{
+		gl->BindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+		gl->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	}
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+
+	// the object, then the balloons around it - the ones next to each
+	// other on the same level are next to each other in data as well
+	bind_corners(0);
+	int k = 0;
+	while (k < count_balloons)
+	{
+		int i = chosen[k]*count_balloons + k;
+		int style = k == 0 ? object_style : around_style;
+		k++;
+		if (first[i] < 0) continue;
+
+		int start = first[i], n = length[i];
+		while (k > 1 && k < count_balloons)
+		{
+			int j = chosen[k]*count_balloons + k;
+			if (first[j] != start + n) break;
+			n += length[j];
+			k++;
+		}
+
+		draw_range(style, start, n);
+	}
+
+	// the undeformed ones - one draw per level
+	GLenum mode = around_style == 1 ? GL_POINTS : (around_style == 2 ? GL_LINES : GL_TRIANGLES);
+	if (instances && around_style >= 1 && around_style <= 3)
+	{
+		int L;
+		for (L = 0; L <= count_levels; L++)
+			level_instances[L] = 0;
+		for (k = 1; k < count_balloons; k++)
+			if (instanced[k]) level_instances[chosen[k] + 1]++;
+		for (L = 0; L < count_levels; L++)
+			level_instances[L + 1] += level_instances[L];
+
+		if (sorted_dirty)
+		{
+			int *at = new int[count_levels];
+			memcpy(at, level_instances, count_levels*sizeof(int));
+			int n = 0;
+			for (k = 1; k < count_balloons; k++)
+			{
+				if (!instanced[k]) continue;
+				memcpy(sorted + 4*at[chosen[k]]++, placement + 4*n, 4*sizeof(float));
+				n++;
+			}
+			delete[] at;
+
+			gl->BindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+			gl->BufferData(GL_ARRAY_BUFFER, 4*instances*sizeof(float), sorted, GL_STREAM_DRAW);
+			sorted_dirty = false;
+		}
+
+		gl->UseProgram(program);
+		gl->EnableVertexAttribArray(PLACEMENT_ATTRIBUTE);
+
+		for (L = 0; L < count_levels; L++)
+		{
+			int n = level_instances[L + 1] - level_instances[L];
+			if (n == 0) continue;
+
+			gl->BindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+			bind_corners(3*(size_t)unit_first[L]);
+
+			gl->BindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+			gl->VertexAttribPointer(PLACEMENT_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, 0,
+									(const char *)0 + 4*level_instances[L]*sizeof(float));
+			gl->VertexAttribDivisor(PLACEMENT_ATTRIBUTE, 1);
+
+			if (mode == GL_LINES)
+				gl->DrawElementsInstanced(GL_LINES, 6*unit_length[L], GL_UNSIGNED_INT, 0, n);
+			else
+				gl->DrawArraysInstanced(mode, 0, 3*unit_length[L], n);
+			draw_calls++;
+			triangles += (long long)n*unit_length[L];
+		}
+
+		gl->VertexAttribDivisor(PLACEMENT_ATTRIBUTE, 0);
+		gl->DisableVertexAttribArray(PLACEMENT_ATTRIBUTE);
+		gl->UseProgram(0);
+	}
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+
+	if (gl->buffers)
+	{
+		gl->BindBuffer(GL_ARRAY_BUFFER, 0);
+		gl->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+}
+
+void Renderer::draw_progress(double fraction)
+{
+	if (fraction < 0) fraction = 0;
+	if (fraction > 1) fraction = 1;
+
+	// the whole picture is 0 .. 1 both ways
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0, 1, 0, 1, -1, 1);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+
+	glColor3f(0.3f, 0.3f, 0.3f);
+	glRectf(0.1f, 0.04f, 0.9f, 0.07f);
+	glColor3f(0.2f, 0.2f, 1.0f);
+	glRectf(0.1f, 0.04f, 0.1f + 0.8f*(float)fraction, 0.07f);
+
+	glPopAttrib();
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+}
+
+
+// ***********************************************************
+//							immediate
+// ***********************************************************
+static void vertex(const Balloon& b, int t, int c)
+{
+	Point P;
+	b.corner(t, c, P);
+
+#if BALLOON_FLOAT
+	glColor4f( P.R, P.G, P.B, P.A);
+	glNormal3f( P.nx, P.ny, P.nz);
+	glVertex3f( P.x, P.y, P.z);
+#else
+	glColor4d( P.R, P.G, P.B, P.A);
+	glNormal3d( P.nx, P.ny, P.nz);
+	glVertex3d( P.x, P.y, P.z);
+#endif
+}
+
+static void draw_balloon(const Balloon& b, int style)
+{
+	int i;
+
+	switch (style)
+	{
+	case 1:
+		// draw as points
+		glBegin(GL_POINTS);
+			for (i = 0; i < b.count; i++)
+			{
+				vertex(b, i, 0);
+				vertex(b, i, 1);
+				vertex(b, i, 2);
+			}
+		glEnd();
+		break;
+	case 2:
+		// draw as lines
+		glBegin(GL_LINES);
+			for (i = 0; i < b.count; i++)
+			{
+				vertex(b, i, 0);
+				vertex(b, i, 1);
+				vertex(b, i, 0);
+				vertex(b, i, 2);
+				vertex(b, i, 1);
+				vertex(b, i, 2);
+			}
+		glEnd();
+		break;
+	case 3:
+		// draw as polygons
+		glBegin(GL_TRIANGLES);
+			for (i = 0; i < b.count; i++)
+			{
+				vertex(b, i, 0);
+				vertex(b, i, 1);
+				vertex(b, i, 2);
+			}
+		glEnd();
+		break;
+	default:
+		// do not draw
+		break;
+	}
+}
+
+void Renderer::draw_immediate(const Balloon *balloons, int count, int object_style, int around_style)
+{
+	draw_calls = 0;
+	if (count < 1) return;
+
+	draw_balloon(balloons[0], object_style);
+
+	for (int j = 1; j < count; j++)
+		if (balloons[j].setup_complete) draw_balloon(balloons[j], around_style);
+}
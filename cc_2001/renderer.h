@@ -0,0 +1,126 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "balloon.h"
+
+// retained-mode drawing of the balloons. the meshes are uploaded once and
+// every frame is a few draw calls: the object, all the deformed balloons
+// around it and the undeformed ones, which are the same unit sphere moved
+// and scaled, as instances of one mesh.
+//
+// needs a current OpenGL context with the fixed function pipeline (the
+// viewer's window or an offscreen one). everything newer than OpenGL 1.1
+// is looked up through the loader given to init. without buffer objects
+// the data stays in client memory (vertex arrays), without shaders and
+// instancing every balloon is in the big buffer.
+typedef void *(*GLLoader)(const char *name);
+
+struct RendererGL;
+
+class Renderer
+{
+public:
+	Renderer();
+	~Renderer();
+
+	// look up the functions of the current context
+	void init(GLLoader loader);
+
+	// copy the meshes of the balloons (the first one is the object).
+	// again after any of them changes.
+	void upload(const Balloon *balloons, int count);
+
+	// the same with levels of detail: levels[0] are the balloons, the
+	// others coarser copies of them (Scene::build_levels). every frame
+	// draws each balloon with the coarsest level fine enough for its size
+	// on the screen.
+	void upload(const Balloon *const *levels, int count_levels, int count);
+
+	// styles as in the .bal file: 0 nothing, 1 points, 2 lines, 3 polygons
+	void draw(int object_style, int around_style);
+
+	// a bar along the bottom of the picture, filled to fraction (0 .. 1) -
+	// for a scene which is still loading. after draw, changes no state.
+	void draw_progress(double fraction);
+
+	// the same one vertex at a time as the viewer used to - for comparing
+	void draw_immediate(const Balloon *balloons, int count, int object_style, int around_style);
+
+	// free the buffers, needs the context still current
+	void release();
+
+	// what init found
+	bool buffers() const;
+	bool instancing() const;
+
+	// longest edge of a triangle in pixels before a finer level is drawn (4)
+	float detail;
+
+	// draw calls of the last draw
+	int draw_calls;
+
+	// triangles of the last draw, every instance counted
+	long long triangles;
+
+	// balloons drawn as instances of the unit sphere
+	int instances;
+
+private:
+	// free the buffers and memory of upload
+	void drop_meshes();
+
+	// the corners of balloons [first, last) go after the others in data
+	void add_corners(const Balloon *balloons, int first, int last);
+
+	// the unit sphere of a tessellation, returns its triangles
+	int add_unit(int segments, int pies, bool color);
+
+	// the level every balloon gets in this frame
+	void choose_levels();
+
+	// point the fixed function arrays at corner first of the vertex data
+	void bind_corners(size_t first);
+
+	void draw_range(int style, int first_triangle, int triangles);
+
+	RendererGL *gl;
+
+	// interleaved corners: position, normal, color (10 floats each).
+	// kept in memory only when there are no buffer objects.
+	float *data;
+	size_t count_data;
+
+	// two line indices per edge of every triangle
+	unsigned int *lines;
+
+	int count_balloons, count_levels;
+
+	// per level and balloon ([level*count_balloons + balloon]): the first
+	// triangle and the triangles in data (-1 and 0 for instances and
+	// balloons without a mesh), and the rows around half the balloon
+	int *first;
+	int *length;
+	float *steps;
+
+	// per balloon: where it is (x, y, z, radius), is it an instance and
+	// the level it had in the last frame
+	float *sphere;
+	unsigned char *instanced;
+	int *chosen;
+
+	// the unit sphere of every level after the meshes in data, and where
+	// every instance is (x, y, z, radius) - by balloon, and sorted by level
+	// the way the last frame used them
+	int *unit_first;
+	int *unit_length;
+	float *placement;
+	float *sorted;
+	int *level_instances;
+	bool sorted_dirty;
+
+	// buffer objects (0 when in memory)
+	unsigned int vertex_buffer, index_buffer, instance_buffer;
+	unsigned int program;
+};
+
+#endif
@@ -0,0 +1,485 @@
+#include "scene.h"
+#include "contact.h"
+#include "refine.h"
+#include "parser.h"
+#include "balb.h"
+#include "stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+
+// ***********************************************************
+//							Scene
+// ***********************************************************
+Scene::Scene()
+{
+	balloons = 0;
+	count = 0;
+
+	segments = pies = 16;
+	object_color = around_color = true;
+	object_style = 3; around_style = 0;
+
+	cached = false;
+	deformed_all = false;
+
+	keys = 0;
+	count_keys = 0;
+
+	progress = 0;
+
+	for (int k = 0; k < SCENE_LEVELS; k++)
+		level[k] = 0;
+	count_levels = 0;
+
+	message[0] = 0;
+}
+
+Scene::~Scene()
+{
+	clear();
+}
+
+void Scene::clear()
+{
+	// the balloons first, their meshes live in the arena (or the file)
+	for (int k = 1; k < count_levels; k++)
+		delete[] level[k];
+	for (int k = 0; k < SCENE_LEVELS; k++)
+		level[k] = 0;
+	count_levels = 0;
+
+	delete[] balloons;
+	balloons = 0;
+	count = 0;
+
+	delete[] keys;
+	keys = 0;
+	count_keys = 0;
+
+	arena.release();
+	level_arena.release();
+	mapped.close();
+
+	cached = false;
+	deformed_all = false;
+}
+
+bool Scene::read(const char *filename)
+{
+	STATS(PhaseTimer timer(PHASE_PARSE);)
+
+	clear();
+
+	// binary or text?
+	char magic[4] = { 0 };
+	FILE *stream = fopen(filename, "rb");
+	if (stream)
+	{
+		if (fread(magic, 1, 4, stream) != 4) magic[0] = 0;
+		fclose(stream);
+	}
+
+	if (memcmp(magic, BALB_MAGIC, 4) == 0) return read_binary(filename);
+	return read_text(filename);
+}
+
+bool Scene::read_text(const char *filename)
+{
+	BalParser parser;
+	BalHeader header;
+
+	if (!parser.open(filename))
+	{
+		snprintf(message, sizeof(message), "%s: cannot open", filename);
+		return false;
+	}
+	if (!parser.header(header))
+	{
+		snprintf(message, sizeof(message), "%s:%s", filename, parser.error());
+		return false;
+	}
+
+	segments = header.segments;
+	pies = header.pies;
+	object_color = header.object_color;
+	around_color = header.around_color;
+	object_style = header.object_style;
+	around_style = header.around_style;
+
+	// the balloons as they come, the header's count may be wrong or huge
+	std::vector<BalBalloon> list;
+	BalBalloon b;
+
+	while (parser.next(b))
+		list.push_back(b);
+	if (parser.error()[0])
+	{
+		snprintf(message, sizeof(message), "%s:%s", filename, parser.error());
+		clear();
+		return false;
+	}
+
+	count = (int)list.size();
+	balloons = new Balloon[count];
+	for (int i = 0; i < count; i++)
+	{
+		balloons[i].x = list[i].x; balloons[i].y = list[i].y; balloons[i].z = list[i].z;
+		balloons[i].radius = list[i].radius; balloons[i].pressure = list[i].pressure;
+	}
+
+	// the animation, if there is one
+	int n;
+	if (!parser.keys(n))
+	{
+		snprintf(message, sizeof(message), "%s:%s", filename, parser.error());
+		clear();
+		return false;
+	}
+
+	if (n > 0)
+	{
+		keys = new Keyframe[n];
+		BalKey k;
+
+		for (int i = 0; i < n; i++)
+		{
+			if (!parser.next_key(k))
+			{
+				snprintf(message, sizeof(message), "%s:%s", filename, parser.error());
+				clear();
+				return false;
+			}
+
+			Keyframe& key = keys[i];
+			key.balloon = k.balloon; key.time = k.time;
+			key.x = k.x; key.y = k.y; key.z = k.z;
+			key.radius = k.radius; key.pressure = k.pressure;
+			count_keys++;
+		}
+
+		std::stable_sort(keys, keys + n, [](const Keyframe& p, const Keyframe& q)
+		{
+			return p.balloon < q.balloon || (p.balloon == q.balloon && p.time < q.time);
+		});
+	}
+
+	return true;
+}
+
+bool Scene::read_binary(const char *filename)
+{
+	// private pages - deform may still change the meshes in memory
+	if (!mapped.open(filename, true))
+	{
+		snprintf(message, sizeof(message), "%s: cannot open", filename);
+		return false;
+	}
+
+	const char *data = mapped.data();
+	size_t size = mapped.size();
+
+	const BalbHeader *h = (const BalbHeader *)data;
+	if (size < sizeof(BalbHeader) || h->version != BALB_VERSION || h->count < 1 ||
+		!Balloon::lattice_fits(h->segments, h->pies) ||
+		size < sizeof(BalbHeader) + h->count*sizeof(BalbBalloon))
+	{
+		snprintf(message, sizeof(message), "%s: cut short or not a .balb file of version %d", filename, BALB_VERSION);
+		clear();
+		return false;
+	}
+
+	segments = h->segments;
+	pies = h->pies;
+	object_color = h->object_color != 0;
+	around_color = h->around_color != 0;
+	object_style = h->object_style;
+	around_style = h->around_style;
+
+	// written by the same kind of machine - the meshes can be used as they are
+	size_t bytes = Balloon::storage_size(segments, pies);
+	bool usable = (h->flags & BALB_GEOMETRY) && h->byte_order == BALB_BYTE_ORDER &&
+		h->bounds_size == sizeof(Bounds) && h->triangle_size == sizeof(Triangle);
+
+	const BalbBalloon *table = (const BalbBalloon *)(data + sizeof(BalbHeader));
+	int i;
+
+	for (i = 0; usable && i < h->count; i++)
+	{
+		unsigned long long at = table[i].geometry;
+		if (at == 0 || at % ARENA_ALIGN != 0 || at > size || size - at < bytes) usable = false;
+	}
+
+	balloons = new Balloon[h->count];
+	count = h->count;
+
+	for (i = 0; i < count; i++)
+	{
+		Balloon& b = balloons[i];
+		b.x = table[i].x; b.y = table[i].y; b.z = table[i].z;
+		b.radius = table[i].radius; b.pressure = table[i].pressure;
+
+		if (usable) b.attach(segments, pies, table[i].color != 0, mapped.writable_data() + table[i].geometry, table[i].bound);
+	}
+
+	// the triangles are used as they are - none may point past the vertices
+	for (i = 0; usable && i < count; i++)
+	{
+		const Balloon& b = balloons[i];
+		unsigned int n = (unsigned int)b.count_vertices;
+
+		for (int t = 0; t < b.count; t++)
+		{
+			const Triangle& T = b.mesh[t];
+			if ((unsigned int)T.a < n && (unsigned int)T.b < n && (unsigned int)T.c < n) continue;
+
+			snprintf(message, sizeof(message), "%s: balloon %d has a triangle with a vertex out of range", filename, i);
+			clear();
+			return false;
+		}
+	}
+
+	if (usable)
+	{
+		cached = true;
+		deformed_all = (h->flags & BALB_EVERYTHING) != 0;
+	}
+	else mapped.close();
+
+	return true;
+}
+
+// the zeros after n bytes up to the next array
+static void write_gap(FILE *stream, size_t n)
+{
+	static const char zeros[ARENA_ALIGN] = { 0 };
+	fwrite(zeros, 1, Arena::rounded(n) - n, stream);
+}
+
+// n bytes of an array and the gap after them
+static void write_rounded(FILE *stream, const void *data, size_t n)
+{
+	fwrite(data, 1, n, stream);
+	write_gap(stream, n);
+}
+
+// the storage of a balloon in the order carve cuts it - array by array,
+// the gaps between them and the padding of the triangles zero, so the
+// same meshes always give the same file
+static void write_geometry(FILE *stream, const Balloon& b)
+{
+	size_t n = b.count_vertices;
+
+	write_rounded(stream, b.vertices.x, 6*n*sizeof(real));
+	write_rounded(stream, b.row_bounds, b.rows*sizeof(Bounds));
+	write_rounded(stream, b.col_bounds, b.cols*sizeof(Bounds));
+	write_rounded(stream, b.moved, n);
+
+	Triangle chunk[256];
+	int t, k;
+
+	for (t = 0; t < b.count; t += k)
+	{
+		for (k = 0; k < 256 && t + k < b.count; k++)
+		{
+			const Triangle& T = b.mesh[t + k];
+			Triangle& C = chunk[k];
+
+			memset(&C, 0, sizeof(C));
+			C.a = T.a; C.b = T.b; C.c = T.c;
+			C.flat = T.flat;
+			C.nx = T.nx; C.ny = T.ny; C.nz = T.nz;
+			C.R = T.R; C.G = T.G; C.B = T.B; C.A = T.A;
+		}
+		fwrite(chunk, sizeof(Triangle), k, stream);
+	}
+	write_gap(stream, b.count*sizeof(Triangle));
+}
+
+bool Scene::write(const char *filename, bool geometry)
+{
+	STATS(PhaseTimer timer(PHASE_EXPORT);)
+
+	FILE *stream = fopen(filename, "wb");
+	if (!stream)
+	{
+		snprintf(message, sizeof(message), "%s: cannot write", filename);
+		return false;
+	}
+
+	// big pieces - the meshes are megabytes each
+	setvbuf(stream, 0, _IOFBF, 1 << 20);
+
+	// the table has one lattice for all the meshes
+	int i;
+	for (i = 0; i < count; i++)
+	{
+		const Balloon& b = balloons[i];
+		if (!b.setup_complete || b.adaptive || b.segments != segments || b.pies != pies) geometry = false;
+	}
+
+	BalbHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, BALB_MAGIC, 4);
+	h.version = BALB_VERSION;
+	h.byte_order = BALB_BYTE_ORDER;
+	h.flags = (geometry ? BALB_GEOMETRY : 0) | (geometry && deformed_all ? BALB_EVERYTHING : 0);
+	h.bounds_size = sizeof(Bounds);
+	h.triangle_size = sizeof(Triangle);
+	h.count = count;
+	h.segments = segments; h.pies = pies;
+	h.object_color = object_color; h.around_color = around_color;
+	h.object_style = object_style; h.around_style = around_style;
+
+	fwrite(&h, sizeof(h), 1, stream);
+
+	// the meshes follow the table, one after another
+	size_t bytes = Balloon::storage_size(segments, pies);
+	unsigned long long at = Arena::rounded(sizeof(BalbHeader) + count*sizeof(BalbBalloon));
+
+	for (i = 0; i < count; i++)
+	{
+		const Balloon& b = balloons[i];
+
+		BalbBalloon t;
+		memset(&t, 0, sizeof(t));
+		t.x = b.x; t.y = b.y; t.z = b.z;
+		t.radius = b.radius; t.pressure = b.pressure;
+		t.color = i == 0 ? object_color : around_color;
+
+		if (geometry)
+		{
+			t.bound = b.bound;
+			t.color = b.color;
+			t.geometry = at;
+			at += bytes;
+		}
+
+		fwrite(&t, sizeof(t), 1, stream);
+	}
+
+	if (geometry)
+	{
+		write_gap(stream, sizeof(BalbHeader) + count*sizeof(BalbBalloon));
+
+		// storage_size is a multiple of the alignment, no gaps after this
+		for (i = 0; i < count; i++)
+			write_geometry(stream, balloons[i]);
+	}
+
+	bool ok = !ferror(stream);
+	if (fclose(stream) != 0) ok = false;
+	if (!ok) snprintf(message, sizeof(message), "%s: cannot write", filename);
+	return ok;
+}
+
+void Scene::setup()
+{
+	if (cached) return;
+
+	STATS(PhaseTimer timer(PHASE_TESSELLATE);)
+
+	// all meshes have the same size - one block for the whole scene
+	arena.reserve(count*Balloon::storage_size(segments, pies));
+
+	for (int i = 0; i < count && !canceled(); i++)
+	{
+		balloons[i].setup(segments, pies, i == 0 ? object_color : around_color, &arena);
+		if (progress) progress->done++;
+	}
+}
+
+void Scene::setup_adaptive(int coarse, bool everything)
+{
+	if (cached || canceled()) return;
+
+	STATS(PhaseTimer timer(PHASE_TESSELLATE);)
+
+	::setup_adaptive(balloons, count, segments, pies, coarse, everything, object_color, around_color, arena);
+	if (progress) progress->done += count;
+}
+
+void Scene::deform(bool everything)
+{
+	if (cached || canceled()) return;
+
+	STATS(PhaseTimer timer(PHASE_DEFORM);)
+
+	deformed_all = everything;
+
+	if (everything)
+	{
+		// all balloons against the ones they touch
+		deform_all(balloons, count, 0, progress ? &progress->done : 0, progress ? &progress->cancel : 0);
+	}
+	else
+	{
+		// press the object against all the others in one pass
+		if (count > 1) balloons[0].deform(balloons + 1, count - 1);
+		if (progress) progress->done += count;
+	}
+}
+
+void Scene::build_levels(int levels)
+{
+	int k, i;
+
+	for (k = 1; k < count_levels; k++)
+		delete[] level[k];
+	level[0] = balloons;
+	count_levels = count > 0 ? 1 : 0;
+
+	if (levels > SCENE_LEVELS) levels = SCENE_LEVELS;
+	if (count < 1 || levels < 2) return;
+
+	STATS(PhaseTimer timer(PHASE_TESSELLATE);)
+
+	// the lattices, until they stop getting coarser
+	int s[SCENE_LEVELS], p[SCENE_LEVELS];
+	size_t bytes = 0;
+	s[0] = segments; p[0] = pies;
+
+	for (k = 1; k < levels; k++)
+	{
+		s[k] = segments >> k; p[k] = pies >> k;
+		if (s[k] < 4) s[k] = 4;
+		if (p[k] < 4) p[k] = 4;
+		if (s[k] >= s[k-1] && p[k] >= p[k-1]) break;
+
+		bytes += count*Balloon::storage_size(s[k], p[k]);
+	}
+	levels = k;
+
+	level_arena.reserve(bytes);
+
+	for (k = 1; k < levels; k++)
+	{
+		Balloon *b = new Balloon[count];
+		for (i = 0; i < count && !canceled(); i++)
+		{
+			b[i].x = balloons[i].x; b[i].y = balloons[i].y; b[i].z = balloons[i].z;
+			b[i].radius = balloons[i].radius; b[i].pressure = balloons[i].pressure;
+			b[i].setup(s[k], p[k], i == 0 ? object_color : around_color, &level_arena);
+			if (progress) progress->done++;
+		}
+
+		// pressed like the balloons themselves
+		if (deformed_all) deform_all(b, count, 0, progress ? &progress->done : 0, progress ? &progress->cancel : 0);
+		else
+		{
+			if (count > 1 && !canceled()) b[0].deform(b + 1, count - 1);
+			if (progress) progress->done += count;
+		}
+
+		// the levels done so far stay
+		if (canceled())
+		{
+			delete[] b;
+			break;
+		}
+		level[k] = b;
+	}
+	count_levels = k;
+}
@@ -0,0 +1,124 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "balloon.h"
+#include "arena.h"
+#include "mapped_file.h"
+#include <atomic>
+
+// most levels of detail a scene keeps for drawing
+#define SCENE_LEVELS 4
+
+// where a balloon is at some time of the animation (see animation.h)
+struct Keyframe
+{
+	int balloon;
+	double time;
+	double x, y, z;
+	double radius;
+	double pressure;
+};
+
+// how far setup, deform and build_levels are, for another thread to show.
+// every balloon set up or deformed is one step (deform of the object
+// alone counts for all of them).
+struct Progress
+{
+	std::atomic<int> done, total;
+
+	// what is being done now, a constant string
+	std::atomic<const char *> stage;
+
+	// set by the other thread to give up: setup, deform and build_levels
+	// return at their next step and leave the scene half done
+	std::atomic<bool> cancel;
+};
+
+// the balloons of one .bal file. the first one is the object, the others
+// press it. nothing here needs a window - the viewer and the batch tool
+// both go through it.
+class Scene
+{
+public:
+	Scene();
+	~Scene();
+
+	// read the header and the balloons, no setup yet. false if the file
+	// cannot be opened or is malformed - error() says where.
+	// a .balb file (recognized by its contents) with meshes in it comes
+	// back set up and deformed - see cached.
+	bool read(const char *filename);
+
+	// binary scene with (geometry) or without the meshes - see balb.h.
+	// the keys are not written, a .balb does not move.
+	bool write(const char *filename, bool geometry);
+
+	// "file:line:column: what is wrong" after a failed read
+	const char *error() const { return message; }
+
+	// tessellate every balloon - all meshes in one arena.
+	// nothing to do if the meshes came from a file.
+	void setup();
+
+	// the same, coarse (segments/coarse x pies/coarse) away from the
+	// balloons each one touches - see refine.h. the lattices then differ
+	// from the header, a .balb gets the balloons only.
+	void setup_adaptive(int coarse, bool everything);
+
+	// object against all the others, or (everything) all of them against
+	// the ones they touch. nothing to do if the meshes came from a file.
+	void deform(bool everything);
+
+	// coarser copies of the balloons for drawing them small: level k is
+	// set up with segments>>k x pies>>k (not below 4) and deformed the way
+	// deform did it, level 0 is balloons itself. after deform.
+	void build_levels(int levels);
+
+	// back to no balloons
+	void clear();
+
+	Balloon *balloons;
+	int count;
+
+	// header of the file
+	int segments, pies;
+	bool object_color, around_color;
+	int object_style, around_style;
+
+	// meshes read from a .balb - deformed already
+	bool cached;
+
+	// all the balloons deformed, not only the object
+	bool deformed_all;
+
+	// the keys after the balloons of a .bal file, by balloon and then by
+	// time - none when nothing moves
+	Keyframe *keys;
+	int count_keys;
+
+	Arena arena;
+
+	// counted up while working if not 0
+	Progress *progress;
+
+	// the levels of build_levels, level[0] == balloons
+	Balloon *level[SCENE_LEVELS];
+	int count_levels;
+
+private:
+	// progress says to give up
+	bool canceled() const { return progress && progress->cancel; }
+
+	bool read_text(const char *filename);
+	bool read_binary(const char *filename);
+
+	// the .balb file the meshes live in
+	MappedFile mapped;
+
+	// meshes of level 1 and up
+	Arena level_arena;
+
+	char message[300];
+};
+
+#endif
@@ -0,0 +1,157 @@
+#include "stats.h"
+#include "balloon.h"
+#include <map>
+#include <mutex>
+#include <string.h>
+#include <utility>
+
+// the counts and where every pair / object is in the lists.
+// static - all zero before the first call
+static std::mutex lock;
+static Stats counted;
+static std::map<std::pair<const Balloon *, const Balloon *>, size_t> pair_index;
+static std::map<const Balloon *, size_t> object_index;
+
+static void clear()
+{
+	counted.deformers.clear();
+	counted.objects.clear();
+	memset(&counted.total, 0, sizeof(counted.total));
+	counted.triangles_renormalized = 0;
+	for (int i = 0; i < PHASE_COUNT; i++)
+	{
+		counted.phase_ms[i] = 0;
+		counted.phase_runs[i] = 0;
+	}
+
+	pair_index.clear();
+	object_index.clear();
+}
+
+static ObjectStats& object(const Balloon *b)
+{
+	std::map<const Balloon *, size_t>::iterator it = object_index.find(b);
+	if (it != object_index.end()) return counted.objects[it->second];
+
+	ObjectStats o;
+	o.object = b;
+	o.deform_calls = 0;
+	o.triangles_renormalized = 0;
+
+	object_index[b] = counted.objects.size();
+	counted.objects.push_back(o);
+	return counted.objects.back();
+}
+
+
+// ***********************************************************
+//							API
+// ***********************************************************
+Stats stats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return counted;
+}
+
+void stats_reset()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	clear();
+}
+
+const char *phase_name(Phase phase)
+{
+	static const char *names[PHASE_COUNT] = { "parse", "tessellate", "deform", "export", "render" };
+	return phase >= 0 && phase < PHASE_COUNT ? names[phase] : "?";
+}
+
+void stats_add(const Balloon *object_balloon, const Balloon *deformer, const DeformCounts& counts)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	std::pair<const Balloon *, const Balloon *> key(object_balloon, deformer);
+	std::map<std::pair<const Balloon *, const Balloon *>, size_t>::iterator it = pair_index.find(key);
+
+	if (it == pair_index.end())
+	{
+		DeformerStats d;
+		d.object = object_balloon;
+		d.deformer = deformer;
+		memset(&d.counts, 0, sizeof(d.counts));
+
+		it = pair_index.insert(std::make_pair(key, counted.deformers.size())).first;
+		counted.deformers.push_back(d);
+	}
+
+	add_counts(counted.deformers[it->second].counts, counts);
+	add_counts(counted.total, counts);
+}
+
+void stats_renormalized(const Balloon *object_balloon, long long triangles)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	ObjectStats& o = object(object_balloon);
+	o.deform_calls++;
+	o.triangles_renormalized += triangles;
+	counted.triangles_renormalized += triangles;
+}
+
+void stats_phase(Phase phase, double ms)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	counted.phase_ms[phase] += ms;
+	counted.phase_runs[phase]++;
+}
+
+
+// ***********************************************************
+//							JSON
+// ***********************************************************
+static long long index_of(const Balloon *b, const Balloon *balloons, int n)
+{
+	if (!b || !balloons || b < balloons || b >= balloons + n) return -1;
+	return b - balloons;
+}
+
+static void write_counts(FILE *out, const DeformCounts& c)
+{
+	fprintf(out, "\"tested\": %lld, \"inside\": %lld, \"discriminant_failures\": %lld",
+			c.tested, c.inside, c.discriminant_failures);
+}
+
+void write_stats_json(FILE *out, const Stats& s, const Balloon *balloons, int n)
+{
+	size_t i;
+
+	fprintf(out, "{\n  \"enabled\": %s,\n  \"phases\": {", BALLOON_STATS ? "true" : "false");
+	for (int p = 0; p < PHASE_COUNT; p++)
+	{
+		fprintf(out, "%s\n    \"%s\": {\"ms\": %.6f, \"runs\": %lld}", p ? "," : "",
+				phase_name((Phase)p), s.phase_ms[p], s.phase_runs[p]);
+	}
+
+	fprintf(out, "\n  },\n  \"total\": {");
+	write_counts(out, s.total);
+	fprintf(out, ", \"triangles_renormalized\": %lld},\n", s.triangles_renormalized);
+
+	fprintf(out, "  \"objects\": [");
+	for (i = 0; i < s.objects.size(); i++)
+	{
+		const ObjectStats& o = s.objects[i];
+		fprintf(out, "%s\n    {\"balloon\": %lld, \"deform_calls\": %lld, \"triangles_renormalized\": %lld}",
+				i ? "," : "", index_of(o.object, balloons, n), o.deform_calls, o.triangles_renormalized);
+	}
+
+	fprintf(out, "\n  ],\n  \"deformers\": [");
+	for (i = 0; i < s.deformers.size(); i++)
+	{
+		const DeformerStats& d = s.deformers[i];
+		fprintf(out, "%s\n    {\"balloon\": %lld, \"deformer\": %lld, ", i ? "," : "",
+				index_of(d.object, balloons, n), index_of(d.deformer, balloons, n));
+		write_counts(out, d.counts);
+		fputc('}', out);
+	}
+	fprintf(out, "\n  ]\n}\n");
+}
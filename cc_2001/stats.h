@@ -0,0 +1,113 @@
+#ifndef STATS_H
+#define STATS_H
+
+// counters of the hot loops and timers of the phases.
+// compile with -DBALLOON_STATS=0 to take them out completely.
+#ifndef BALLOON_STATS
+#define BALLOON_STATS 1
+#endif
+
+#if BALLOON_STATS
+#define STATS(...) __VA_ARGS__
+#define STATS_COUNTS(counts) (counts)
+#else
+#define STATS(...)
+#define STATS_COUNTS(counts) 0
+#endif
+
+#include <stdio.h>
+#include <chrono>
+#include <vector>
+
+class Balloon;
+
+// what the deform kernel saw
+struct DeformCounts
+{
+	long long tested;					// vertex and deformer pairs checked exactly
+	long long inside;					// vertex inside the deformer
+	long long discriminant_failures;	// inside, but no intersection (D < 0) - not moved
+};
+
+// one balloon pressing another
+struct DeformerStats
+{
+	const Balloon *object;
+	const Balloon *deformer;
+	DeformCounts counts;
+};
+
+// one deformed balloon. the triangles are renormalized once after all its
+// deformers moved their vertices, a quad often touched by several of them -
+// so they are counted per object, not per deformer.
+struct ObjectStats
+{
+	const Balloon *object;
+	long long deform_calls;
+	long long triangles_renormalized;
+};
+
+enum Phase
+{
+	PHASE_PARSE,
+	PHASE_TESSELLATE,
+	PHASE_DEFORM,
+	PHASE_EXPORT,
+	PHASE_RENDER,
+	PHASE_COUNT
+};
+
+struct Stats
+{
+	// in the order they first showed up
+	std::vector<DeformerStats> deformers;
+	std::vector<ObjectStats> objects;
+
+	// all of them together
+	DeformCounts total;
+	long long triangles_renormalized;
+
+	// wall clock time and number of runs of every phase
+	double phase_ms[PHASE_COUNT];
+	long long phase_runs[PHASE_COUNT];
+};
+
+// everything counted since the start (or the last reset)
+Stats stats();
+void stats_reset();
+
+// "parse", "tessellate", ...
+const char *phase_name(Phase phase);
+
+// the stats as JSON. balloons (may be 0) turns the pointers into indices,
+// the others are written as -1.
+void write_stats_json(FILE *out, const Stats& s, const Balloon *balloons, int n);
+
+// for the balloon code
+void stats_add(const Balloon *object, const Balloon *deformer, const DeformCounts& counts);
+void stats_renormalized(const Balloon *object, long long triangles);
+void stats_phase(Phase phase, double ms);
+
+inline void add_counts(DeformCounts& to, const DeformCounts& from)
+{
+	to.tested += from.tested;
+	to.inside += from.inside;
+	to.discriminant_failures += from.discriminant_failures;
+}
+
+// times the phase from here to the end of the block
+class PhaseTimer
+{
+public:
+	PhaseTimer(Phase phase) : phase(phase), start(std::chrono::steady_clock::now()) {}
+	~PhaseTimer()
+	{
+		stats_phase(phase, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+private:
+	Phase phase;
+	std::chrono::steady_clock::time_point start;
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include "sweep.h"
+#include "contact.h"
+#include "threadpool.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+
+// ***********************************************************
+//							ranges
+// ***********************************************************
+static const char *field_names[] = { "x", "y", "z", "radius", "pressure" };
+
+const char *sweep_field_name(SweepField field)
+{
+	return field_names[field];
+}
+
+bool sweep_range(const char *property, const char *values, SweepRange& range)
+{
+	// balloon.field
+	char *end;
+	long balloon = strtol(property, &end, 10);
+	if (end == property || *end != '.' || balloon < 0) return false;
+
+	int field;
+	for (field = 0; field < 5; field++)
+		if (strcmp(end + 1, field_names[field]) == 0) break;
+	if (field == 5) return false;
+
+	range.balloon = (int)balloon;
+	range.field = (SweepField)field;
+
+	// from:to:steps, or one value
+	char rest;
+	if (sscanf(values, "%lf:%lf:%d%c", &range.from, &range.to, &range.steps, &rest) == 3)
+		return range.steps >= 1;
+	if (sscanf(values, "%lf%c", &range.from, &rest) == 1)
+	{
+		range.to = range.from;
+		range.steps = 1;
+		return true;
+	}
+	return false;
+}
+
+long long sweep_variants(const SweepRange *ranges, int count_ranges)
+{
+	long long count = 1;
+	for (int r = 0; r < count_ranges && count <= SWEEP_MAX_VARIANTS; r++)
+		count *= ranges[r].steps;
+	return count;
+}
+
+
+// ***********************************************************
+//							Sweep
+// ***********************************************************
+Sweep::Sweep(const Scene& base, const SweepRange *ranges, int count_ranges) : base(base)
+{
+	this->ranges.assign(ranges, ranges + count_ranges);
+
+	count_variants = (int)sweep_variants(ranges, count_ranges);
+
+	// the memory comes with the first variant of each
+	count_workspaces = thread_pool().size();
+	workspaces = new Workspace[count_workspaces];
+	for (int k = 0; k < count_workspaces; k++)
+	{
+		workspaces[k].balloons = new Balloon[base.count];
+		workspaces[k].deformation = 0;
+		free_workspaces.push_back(k);
+	}
+}
+
+Sweep::~Sweep()
+{
+	// the balloons first, their meshes live in the arenas
+	for (int k = 0; k < count_workspaces; k++)
+	{
+		delete workspaces[k].deformation;
+		delete[] workspaces[k].balloons;
+	}
+	delete[] workspaces;
+}
+
+double Sweep::value(int variant, int range) const
+{
+	// the last range is the lowest digit
+	for (int r = (int)ranges.size() - 1; r > range; r--)
+		variant /= ranges[r].steps;
+
+	const SweepRange& R = ranges[range];
+	int i = variant % R.steps;
+	if (R.steps == 1) return R.from;
+	return R.from + (R.to - R.from)*i/(R.steps - 1);
+}
+
+void Sweep::compute(Workspace& w, int variant, bool everything)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	Balloon *b = w.balloons;
+	int n = base.count;
+	int k;
+
+	std::vector<Pose> poses(n);
+	for (k = 0; k < n; k++)
+	{
+		const Balloon& B = base.balloons[k];
+		poses[k].x = B.x; poses[k].y = B.y; poses[k].z = B.z;
+		poses[k].radius = B.radius; poses[k].pressure = B.pressure;
+	}
+
+	for (size_t r = 0; r < ranges.size(); r++)
+	{
+		Pose& P = poses[ranges[r].balloon];
+		double v = value(variant, (int)r);
+		switch (ranges[r].field)
+		{
+		case SWEEP_X: P.x = v; break;
+		case SWEEP_Y: P.y = v; break;
+		case SWEEP_Z: P.z = v; break;
+		case SWEEP_RADIUS: P.radius = v; break;
+		case SWEEP_PRESSURE: P.pressure = v; break;
+		}
+	}
+
+	// the same lattice every time - the second setup keeps the memory
+	if (w.arena.size() == 0) w.arena.reserve(n*Balloon::storage_size(base.segments, base.pies));
+
+	// inside the pool the loops of setup and deform run on this thread
+	if (everything)
+	{
+		for (k = 0; k < n; k++)
+		{
+			b[k].x = poses[k].x; b[k].y = poses[k].y; b[k].z = poses[k].z;
+			b[k].radius = poses[k].radius; b[k].pressure = poses[k].pressure;
+			b[k].setup(base.segments, base.pies, k == 0 ? base.object_color : base.around_color, &w.arena);
+		}
+		deform_all(b, n);
+	}
+	else press_object(b, &poses[0], n, w.deformation, base.segments, base.pies,
+					  base.object_color, base.around_color, &w.arena);
+
+	SweepResult& result = results[variant];
+
+	// the volume of the object from the tetrahedra between its center and
+	// every triangle
+	const Balloon& o = b[0];
+	const real *X = o.vertices.x, *Y = o.vertices.y, *Z = o.vertices.z;
+	double volume = 0;
+	int t;
+
+	for (t = 0; t < o.count; t++)
+	{
+		const Triangle& T = o.mesh[t];
+		double ax = X[T.a] - o.x, ay = Y[T.a] - o.y, az = Z[T.a] - o.z;
+		double bx = X[T.b] - o.x, by = Y[T.b] - o.y, bz = Z[T.b] - o.z;
+		double cx = X[T.c] - o.x, cy = Y[T.c] - o.y, cz = Z[T.c] - o.z;
+		volume += ax*(by*cz - bz*cy) + ay*(bz*cx - bx*cz) + az*(bx*cy - by*cx);
+	}
+	result.volume = fabs(volume)/6;
+	result.bound = o.bound;
+
+	result.flat = 0;
+	for (k = 0; k < n; k++)
+		for (t = 0; t < b[k].count; t++)
+			if (b[k].mesh[t].flat) result.flat++;
+
+	result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Sweep::run(bool everything, void (*fn)(void *, int, const Balloon *, int), void *ctx)
+{
+	results.assign(count_variants, SweepResult());
+
+	thread_pool().parallel_for(count_variants, 1, [&](int first, int last)
+	{
+		// a workspace no other thread uses now
+		int k;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			k = free_workspaces.back();
+			free_workspaces.pop_back();
+		}
+
+		for (int v = first; v < last; v++)
+		{
+			compute(workspaces[k], v, everything);
+			fn(ctx, v, workspaces[k].balloons, base.count);
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		free_workspaces.push_back(k);
+	});
+}
+
+
+// ***********************************************************
+//							JSON
+// ***********************************************************
+void write_sweep_json(FILE *out, const Sweep& sweep, double milliseconds)
+{
+	int r, v;
+
+	fprintf(out, "{\n  \"variants\": %d,\n  \"ms\": %.6f,\n  \"variants_per_second\": %.3f,\n  \"ranges\": [",
+			sweep.variants(), milliseconds, milliseconds > 0 ? 1000*sweep.variants()/milliseconds : 0.0);
+	for (r = 0; r < sweep.count_ranges(); r++)
+	{
+		const SweepRange& R = sweep.range(r);
+		fprintf(out, "%s\n    {\"balloon\": %d, \"field\": \"%s\", \"from\": %.17g, \"to\": %.17g, \"steps\": %d}",
+				r ? "," : "", R.balloon, sweep_field_name(R.field), R.from, R.to, R.steps);
+	}
+
+	fprintf(out, "\n  ],\n  \"results\": [");
+	for (v = 0; v < sweep.variants(); v++)
+	{
+		const SweepResult& s = sweep.results[v];
+		fprintf(out, "%s\n    {\"variant\": %d, \"values\": [", v ? "," : "", v);
+		for (r = 0; r < sweep.count_ranges(); r++)
+			fprintf(out, "%s%.17g", r ? ", " : "", sweep.value(v, r));
+		fprintf(out, "], \"volume\": %.9g, \"bound\": %.9g, \"flat\": %d, \"ms\": %.6f}",
+				s.volume, s.bound, s.flat, s.milliseconds);
+	}
+	fprintf(out, "\n  ]\n}\n");
+}
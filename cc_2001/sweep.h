@@ -0,0 +1,121 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "scene.h"
+#include "deformation.h"
+#include <stdio.h>
+#include <mutex>
+#include <vector>
+
+// what a range changes
+enum SweepField { SWEEP_X, SWEEP_Y, SWEEP_Z, SWEEP_RADIUS, SWEEP_PRESSURE };
+
+// one property of one balloon taking steps values from .. to (both ends
+// included, from alone for one step)
+struct SweepRange
+{
+	int balloon;
+	SweepField field;
+	double from, to;
+	int steps;
+};
+
+// "balloon.field" ("1.pressure") and "from:to:steps" ("0.5:1.5:5") into
+// a range, false if they are not
+bool sweep_range(const char *property, const char *values, SweepRange& range);
+
+// name of a field as sweep_range reads it
+const char *sweep_field_name(SweepField field);
+
+// most variants a Sweep takes - their results alone are some 30 MB
+#define SWEEP_MAX_VARIANTS 1000000
+
+// number of variants of the ranges, counted in 64 bits (and stopping
+// above SWEEP_MAX_VARIANTS) so that it cannot overflow
+long long sweep_variants(const SweepRange *ranges, int count_ranges);
+
+// what became of one variant
+struct SweepResult
+{
+	// inside the object's mesh, and its farthest vertex from the center
+	double volume;
+	double bound;
+
+	// triangles deform turned flat, all the balloons together
+	int flat;
+
+	// setup and deformation
+	double milliseconds;
+};
+
+// every combination of the values of the ranges (the last range changing
+// fastest) is one variant of the base scene. the variants are set up and
+// deformed independently, spread over the thread pool one variant per
+// thread at a time. a thread keeps its balloons and their memory from one
+// variant to the next, the unit spheres come from the shared tessellations
+// - after the first few variants nothing is allocated any more. with the
+// object alone deformed a thread also keeps its Deformation: the next
+// variant only sets up and re-presses what its values changed.
+class Sweep
+{
+public:
+	// base only read, its balloons are copied. the ranges must name
+	// balloons of it and give at most SWEEP_MAX_VARIANTS variants.
+	Sweep(const Scene& base, const SweepRange *ranges, int count_ranges);
+	~Sweep();
+
+	int variants() const { return count_variants; }
+	int count_ranges() const { return (int)ranges.size(); }
+	const SweepRange& range(int r) const { return ranges[r]; }
+
+	// the value range r has in variant v
+	double value(int variant, int range) const;
+
+	// compute all the variants, deformed like base.deform(everything).
+	// done(variant, balloons, count) is called on the thread which did
+	// it - the balloons are used again after it returns.
+	template <class F> void run(bool everything, F done)
+	{
+		run(everything, call<F>, &done);
+	}
+
+	// per variant, after run
+	std::vector<SweepResult> results;
+
+private:
+	template <class F> static void call(void *f, int variant, const Balloon *balloons, int count)
+	{
+		(*(F *)f)(variant, balloons, count);
+	}
+
+	void run(bool everything, void (*fn)(void *, int, const Balloon *, int), void *ctx);
+
+	// the balloons and memory of one thread
+	struct Workspace
+	{
+		Balloon *balloons;
+		Arena arena;
+
+		// of balloons[0], deformed alone
+		Deformation *deformation;
+	};
+
+	// variant into the balloons of w, set up and deformed
+	void compute(Workspace& w, int variant, bool everything);
+
+	const Scene& base;
+	std::vector<SweepRange> ranges;
+	int count_variants;
+
+	// one per thread of the pool, the free ones on the stack
+	Workspace *workspaces;
+	int count_workspaces;
+	std::vector<int> free_workspaces;
+	std::mutex lock;
+};
+
+// the ranges and, per variant, its values and results as JSON - after
+// run, which took milliseconds
+void write_sweep_json(FILE *out, const Sweep& sweep, double milliseconds);
+
+#endif
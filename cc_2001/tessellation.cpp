@@ -0,0 +1,258 @@
+#include "tessellation.h"
+#include <math.h>
+#include <mutex>
+#include <vector>
+
+#define PI 3.1415
+
+
+// ***********************************************************
+//							baked
+// ***********************************************************
+
+// cos and sin the compiler can evaluate. the sums run on pairs of doubles
+// (hi + lo, about 106 bits), so the result is the correctly rounded double.
+// libm's cos and sin are not always - at a few angles (sin of column 10 of
+// 16x16, cos of column 57 of 60x60) they are one ulp off, so a baked
+// lattice can differ from the run-time one in the last digit.
+struct Pair
+{
+	double hi, lo;
+};
+
+static constexpr Pair quick_sum(double a, double b)
+{
+	double s = a + b;
+	return { s, b - (s - a) };
+}
+
+static constexpr Pair exact_sum(double a, double b)
+{
+	double s = a + b;
+	double v = s - a;
+	return { s, (a - (s - v)) + (b - v) };
+}
+
+static constexpr Pair exact_product(double a, double b)
+{
+	// halves of 26 bits multiply without rounding
+	double ta = 134217729.0*a, tb = 134217729.0*b;
+	double ah = ta - (ta - a), al = a - ah;
+	double bh = tb - (tb - b), bl = b - bh;
+	double p = a*b;
+	return { p, ((ah*bh - p) + ah*bl + al*bh) + al*bl };
+}
+
+static constexpr Pair add(Pair a, Pair b)
+{
+	Pair s = exact_sum(a.hi, b.hi);
+	return quick_sum(s.hi, s.lo + a.lo + b.lo);
+}
+
+static constexpr Pair multiply(Pair a, Pair b)
+{
+	Pair p = exact_product(a.hi, b.hi);
+	return quick_sum(p.hi, p.lo + a.hi*b.lo + a.lo*b.hi);
+}
+
+static constexpr Pair divide(Pair a, double d)
+{
+	double q = a.hi/d;
+	Pair p = exact_product(q, d);
+	Pair r = add(a, { -p.hi, -p.lo });
+	return quick_sum(q, r.hi/d);
+}
+
+// sin (odd) or cos of x in [0, 2pi]
+static constexpr double baked_trig(double x, bool odd)
+{
+	// x - k*pi/2 lands in [-pi/4, pi/4]
+	const Pair half_pi = { 1.5707963267948966, 6.123233995736766e-17 };
+	int k = (int)(x/half_pi.hi + 0.5);
+	Pair r = add({ x, 0 }, multiply(half_pi, { -(double)k, 0 }));
+
+	// sin(r + k*pi/2) is one of sin r, cos r, -sin r, -cos r
+	bool series_sin = odd == (k%2 == 0);
+	bool negative = odd ? (k%4 >= 2) : (k%4 == 1 || k%4 == 2);
+
+	// taylor, the terms are below 1e-40 long before n = 30
+	Pair r2 = multiply(r, r);
+	Pair term = series_sin ? r : Pair{ 1, 0 };
+	Pair sum = term;
+	for (int n = series_sin ? 2 : 1; n < 30; n += 2)
+	{
+		term = divide(divide(multiply(term, r2), -(double)n), (double)(n + 1));
+		sum = add(sum, term);
+	}
+
+	return negative ? -sum.hi : sum.hi;
+}
+
+// the angles of one segments x pies lattice, as build computes them
+template <int segments, int pies>
+struct Angles
+{
+	double ring[segments + 1];
+	double col_sin[pies + 1], col_cos[pies + 1];
+};
+
+template <int segments, int pies>
+static constexpr Angles<segments, pies> bake()
+{
+	Angles<segments, pies> a = {};
+	for (int i = 0; i <= segments; i++)
+		a.ring[i] = baked_trig(PI*i/segments, false);
+	for (int j = 0; j <= pies; j++)
+	{
+		a.col_sin[j] = baked_trig(2*PI*j/pies, true);
+		a.col_cos[j] = baked_trig(2*PI*j/pies, false);
+	}
+	return a;
+}
+
+// constexpr - computed while compiling, stored in the program
+template <int segments, int pies>
+static constexpr Angles<segments, pies> baked_angles = bake<segments, pies>();
+
+struct Baked
+{
+	int segments, pies;
+	const double *ring, *col_sin, *col_cos;
+};
+
+#define BAKE(s, p) { s, p, baked_angles<s, p>.ring, baked_angles<s, p>.col_sin, baked_angles<s, p>.col_cos },
+static const Baked baked[] = { TESSELLATION_BAKED { 0, 0, 0, 0, 0 } };
+#undef BAKE
+
+
+// ***********************************************************
+//							cache
+// ***********************************************************
+
+
+// all tessellations built so far - a handful at most
+struct Cache
+{
+	std::mutex lock;
+	std::vector<Tessellation *> list;
+
+	~Cache()
+	{
+		for (size_t i = 0; i < list.size(); i++)
+		{
+			if (!list[i]->baked)
+			{
+				delete[] list[i]->ring;
+				delete[] list[i]->col_sin;
+			}
+			delete[] list[i]->mesh;
+			delete list[i];
+		}
+	}
+};
+
+static Cache cache;
+
+
+void lattice_triangles(int segments, int pies, bool color, Triangle *mesh)
+{
+	// two for each quad, row by row
+	//   B---D
+	//   | \ |
+	//   A---C
+	int i, j;
+	int k = 0;
+
+	for (i = 1; i <= segments; i++)
+	{
+		for (j = 0; j < pies; j++)
+		{
+			int A = i*(pies+1) + j;
+			int B = (i-1)*(pies+1) + j;
+			int C = A + 1;
+			int D = B + 1;
+
+			double R = 1.0;
+			double G = 1.0;
+
+			if (color && (j%2 == i%2))
+			{
+				R = .2;
+				G = .2;
+			}
+
+			mesh[k].a = A; mesh[k].b = C; mesh[k].c = B;
+			mesh[k].nx = mesh[k].ny = mesh[k].nz = 0;
+			mesh[k].R = R; mesh[k].G = G; mesh[k].B = 1.0; mesh[k].A = 1.0;
+			mesh[k++].flat = false;
+
+			mesh[k].a = C; mesh[k].b = D; mesh[k].c = B;
+			mesh[k].nx = mesh[k].ny = mesh[k].nz = 0;
+			mesh[k].R = R; mesh[k].G = G; mesh[k].B = 1.0; mesh[k].A = 1.0;
+			mesh[k++].flat = false;
+		}
+	}
+}
+
+static Tessellation *build(int segments, int pies, bool color)
+{
+	Tessellation *t = new Tessellation;
+	t->segments = segments;
+	t->pies = pies;
+	t->color = color;
+
+	int i, j;
+
+	t->baked = false;
+	for (i = 0; baked[i].segments; i++)
+	{
+		if (baked[i].segments == segments && baked[i].pies == pies)
+		{
+			t->ring = baked[i].ring;
+			t->col_sin = baked[i].col_sin;
+			t->col_cos = baked[i].col_cos;
+			t->baked = true;
+		}
+	}
+
+	if (!t->baked)
+	{
+		double *ring = new double[segments + 1];
+		for (i = 0; i <= segments; i++)
+			ring[i] = cos(PI*i/segments);
+
+		// one block for both
+		double *col_sin = new double[2*(pies + 1)];
+		double *col_cos = col_sin + pies + 1;
+		for (j = 0; j <= pies; j++)
+		{
+			col_sin[j] = sin(2*PI*j/pies);
+			col_cos[j] = cos(2*PI*j/pies);
+		}
+
+		t->ring = ring;
+		t->col_sin = col_sin;
+		t->col_cos = col_cos;
+	}
+
+	t->count = 2*segments*pies;
+	t->mesh = new Triangle[t->count];
+	lattice_triangles(segments, pies, color, t->mesh);
+
+	return t;
+}
+
+const Tessellation& tessellation(int segments, int pies, bool color)
+{
+	std::lock_guard<std::mutex> guard(cache.lock);
+
+	for (size_t i = 0; i < cache.list.size(); i++)
+	{
+		Tessellation *t = cache.list[i];
+		if (t->segments == segments && t->pies == pies && t->color == color) return *t;
+	}
+
+	Tessellation *t = build(segments, pies, color);
+	cache.list.push_back(t);
+	return *t;
+}
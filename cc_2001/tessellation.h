@@ -0,0 +1,44 @@
+#ifndef TESSELLATION_H
+#define TESSELLATION_H
+
+#include "balloon.h"
+
+// the lattices whose angles are computed by the compiler and stored in the
+// program - no cos or sin at all when a scene uses only these. a list of
+// BAKE(segments, pies), compile with -DTESSELLATION_BAKED="BAKE(8, 8) ..."
+// for others (each one costs (segments + 1 + 2*(pies + 1))*8 bytes).
+#ifndef TESSELLATION_BAKED
+#define TESSELLATION_BAKED BAKE(16, 16) BAKE(30, 30) BAKE(60, 60)
+#endif
+
+// unit sphere cut into segments x pies, shared by all the balloons set up
+// with the same numbers. the rings are kept as their cos/sin values, so a
+// balloon only scales and moves them - no trigonometry per vertex.
+struct Tessellation
+{
+	int segments, pies;
+	bool color;
+
+	// per row (segments + 1): cos of the angle from the top
+	const double *ring;
+
+	// per column (pies + 1): sin and cos around the axis
+	const double *col_sin, *col_cos;
+
+	// the angles are one of TESSELLATION_BAKED, not allocated
+	bool baked;
+
+	// triangles of the lattice with their colours, not deformed
+	Triangle *mesh;
+	int count;
+};
+
+// the tessellation for these numbers, built on the first call.
+// safe to call from several threads, the result lives until the program ends.
+const Tessellation& tessellation(int segments, int pies, bool color);
+
+// the triangles of a segments x pies lattice into mesh (2*segments*pies),
+// as in Tessellation - for lattices which are not in the cache
+void lattice_triangles(int segments, int pies, bool color, Triangle *mesh);
+
+#endif
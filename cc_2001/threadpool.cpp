@@ -0,0 +1,184 @@
+#include "threadpool.h"
+#include <stdlib.h>
+
+// set on the pool's own threads (and the caller while it helps),
+// loops started from there run serially
+static thread_local bool inside_pool = false;
+
+
+// ***********************************************************
+//							ThreadPool
+// ***********************************************************
+ThreadPool::ThreadPool(int n)
+{
+	if (n <= 0) n = (int)std::thread::hardware_concurrency();
+	if (n <= 0) n = 1;
+
+	count = n;
+	queues = new Queue[count];
+	generation = 0;
+	active = 0;
+	quit = false;
+
+	// the caller is thread 0
+	threads = new std::thread[count];
+	for (int i = 1; i < count; i++)
+		threads[i] = std::thread(&ThreadPool::worker, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_all();
+
+	for (int i = 1; i < count; i++)
+		threads[i].join();
+
+	delete[] threads;
+	delete[] queues;
+}
+
+void ThreadPool::run(int n, int grain, void (*fn)(void *, int, int), void *ctx)
+{
+	if (n <= 0) return;
+	if (grain < 1) grain = 1;
+
+	int chunks = (n + grain - 1) / grain;
+
+	if (count == 1 || chunks == 1 || inside_pool || !job_lock.try_lock())
+	{
+		fn(ctx, 0, n);
+		return;
+	}
+
+	job_fn = fn;
+	job_ctx = ctx;
+	job_n = n;
+	job_grain = grain;
+
+	// every thread gets a contiguous share of the chunks
+	for (int i = 0; i < count; i++)
+	{
+		std::lock_guard<std::mutex> guard(queues[i].lock);
+		queues[i].first = (int)((long long)chunks * i / count);
+		queues[i].last = (int)((long long)chunks * (i + 1) / count);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		active = count - 1;
+		generation++;
+	}
+	wake.notify_all();
+
+	inside_pool = true;
+	work(0);
+	inside_pool = false;
+
+	// wait for the others to finish their last chunks
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		while (active > 0) finished.wait(guard);
+	}
+
+	job_lock.unlock();
+}
+
+void ThreadPool::worker(int id)
+{
+	inside_pool = true;
+	int seen = 0;
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			while (!quit && generation == seen) wake.wait(guard);
+			if (quit) return;
+			seen = generation;
+		}
+
+		work(id);
+
+		std::lock_guard<std::mutex> guard(lock);
+		if (--active == 0) finished.notify_one();
+	}
+}
+
+void ThreadPool::work(int id)
+{
+	int chunk;
+	while (next_chunk(id, chunk))
+	{
+		int begin = chunk*job_grain;
+		int end = begin + job_grain < job_n ? begin + job_grain : job_n;
+		job_fn(job_ctx, begin, end);
+	}
+}
+
+bool ThreadPool::next_chunk(int id, int& chunk)
+{
+	// own share first, from the front
+	{
+		Queue& q = queues[id];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (q.first < q.last)
+		{
+			chunk = q.first++;
+			return true;
+		}
+	}
+
+	// then steal from the back of the others
+	for (int i = 1; i < count; i++)
+	{
+		Queue& q = queues[(id + i) % count];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (q.first < q.last)
+		{
+			chunk = --q.last;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+// ***********************************************************
+//							shared pool
+// ***********************************************************
+static ThreadPool *pool = 0;
+static int pool_threads = 0;
+static std::mutex pool_lock;
+
+ThreadPool& thread_pool()
+{
+	std::lock_guard<std::mutex> guard(pool_lock);
+	if (!pool)
+	{
+		// BALLOON_THREADS sets the default for programs which do not choose
+		int n = pool_threads;
+		if (n == 0 && getenv("BALLOON_THREADS")) n = atoi(getenv("BALLOON_THREADS"));
+		pool = new ThreadPool(n);
+	}
+	return *pool;
+}
+
+void set_thread_count(int n)
+{
+	std::lock_guard<std::mutex> guard(pool_lock);
+	if (pool && n == pool_threads) return;
+
+	delete pool;
+	pool = 0;
+	pool_threads = n;
+}
+
+int thread_count()
+{
+	return thread_pool().size();
+}
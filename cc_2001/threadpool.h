@@ -0,0 +1,79 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// fixed set of worker threads running parallel loops.
+// the loop range is cut into chunks, every thread starts on its own
+// contiguous share and steals chunks from the others when it runs dry.
+// the chunks never overlap, so loops whose iterations are independent
+// give the same result for any number of threads.
+class ThreadPool
+{
+public:
+	// threads = 0 -> one per processor core
+	ThreadPool(int threads);
+	~ThreadPool();
+
+	// number of threads working on a loop (including the caller)
+	int size() const { return count; }
+
+	// calls fn(ctx, begin, end) for chunks of at most grain iterations
+	// covering [0, n), returns when all of them are done.
+	// nested calls (and calls while another loop runs) run serially.
+	void run(int n, int grain, void (*fn)(void *, int, int), void *ctx);
+
+	// the same for anything callable as f(begin, end)
+	template <class F> void parallel_for(int n, int grain, F f)
+	{
+		run(n, grain, call<F>, &f);
+	}
+
+private:
+	template <class F> static void call(void *f, int begin, int end)
+	{
+		(*(F *)f)(begin, end);
+	}
+
+	// chunks still waiting in one thread's share
+	struct Queue
+	{
+		std::mutex lock;
+		int first, last;
+	};
+
+	void worker(int id);
+	void work(int id);
+	bool next_chunk(int id, int& chunk);
+
+	int count;
+	std::thread *threads;
+	Queue *queues;
+
+	// the loop being run
+	void (*job_fn)(void *, int, int);
+	void *job_ctx;
+	int job_n;
+	int job_grain;
+
+	std::mutex job_lock;		// one loop at a time
+	std::mutex lock;			// guards the fields below
+	std::condition_variable wake;
+	std::condition_variable finished;
+	int generation;
+	int active;
+	bool quit;
+};
+
+// the pool used by the balloon code
+ThreadPool& thread_pool();
+
+// number of threads for the balloon code, 0 = one per core (or the
+// BALLOON_THREADS environment variable), 1 = no threads.
+// must not be called while a loop is running.
+void set_thread_count(int n);
+int thread_count();
+
+#endif
@@ -0,0 +1,15 @@
+2
+16 16
+1 0 3 2
+
+
+ 0  0  0	2  1
+
+ 4  0  0	2  1
+
+
+4
+ 1  1	2  0  0	2  1
+ 1  2	2  0  0	2  1.5
+ 1  3	3  .5 0	2  .5
+ 1  4	4  0  0	2  1
@@ -0,0 +1,79 @@
+42
+60 60
+0 0 3 0
+
+
+ 0  0  0	2   1
+
+ 0  -1 0	2   .8
+ 3  0  0	1.5   -.7
+ 2  0  2	1.5   -.5
+ 2  0  -2	1.5   -.5
+
+ -2   0  2	1.5   -.5
+ -2   0  -2	1.5   -.5
+ 2.3  0  1       .5   4
+ 2.3  0 -1       .5   4
+
+ 1.6   1.2  .1   .1    -.9
+ -1.6  1.2  .1   .1    -.9
+ 1.6   1.2  -.1   .1    -.9
+ -1.6  1.2  -.1   .1    -.9
+
+ 1.2   1.6  .1    .1     -.9
+ -1.2  1.6  .1    .1     -.9
+ 1.2   1.6  -.1    .1     -.9
+ -1.2  1.6 -.1    .1     -.9
+
+ .8    1.8  .1     .1     -.85
+ -.8   1.8  .1     .1     -.85
+ .8    1.8  -.1     .1     -.85
+ -.8   1.8 -.1     .1     -.85
+
+ .4    2    .1     .1     -.93
+ -.4   2    .1     .1     -.93
+ .4    2    -.1     .1     -.93
+ -.4   2   -.1     .1     -.93
+
+ .1   2    .4    .1     -.9
+ -.1  2    .4    .1     -.9
+ .1   2   -.4    .1     -.9
+ -.1  2   -.4    .1     -.9
+
+ .1   1.8    .8     .1     -.85
+ -.1  1.8    .8     .1     -.85
+ .1   1.8   -.8    .1     -.85
+ -.1  1.8   -.8     .1     -.85
+
+ .1    1.6     1.2     .1     -.93
+ -.1   1.6     1.2     .1     -.93
+ .1    1.6    -1.2     .1     -.93
+ -.1   1.6    -1.2     .1     -.93
+
+ .1    1.2   1.6    .1     -.9
+ -.1   1.2   1.6    .1     -.9
+ .1    1.2   -1.6    .1     -.9
+ -.1   1.2  -1.6    .1     -.9
+
+
+ 0  118  0	120   .4
+
+14
+ 3  .5	2  .3  2	1.5   -.5
+ 3  1	2  0   2	1.5   -.5
+ 6  .5	-2 .3 -2	1.5   -.5
+ 6  1	-2 0  -2	1.5   -.5
+
+ 4  1.5	2  .3 -2	1.5   -.5
+ 4  2	2  0  -2	1.5   -.5
+ 5  1.5	-2 .3  2	1.5   -.5
+ 5  2	-2 0   2	1.5   -.5
+
+ 2  1	3  .2  0	1.5   -.7
+ 2  2	3  0   0	1.5   -.7
+
+ 0  1	0  0   0	2   1.15
+ 0  2	0  0   0	2   1
+
+ 1  1	0 -1.1 0	2.05   .8
+ 1  2	0 -1   0	2   .8